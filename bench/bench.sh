@@ -0,0 +1,123 @@
+#!/bin/sh
+# End to end benchmark of smallsh, run by make bench.
+# usage: bench.sh path/to/smallsh [commands per workload]
+#
+# Every workload is a generated command stream fed to the shell on stdin. It runs twice:
+# plain to measure throughput and peak rss (memstats at the end of the stream), then with
+# every line behind the time builtin to get per-command wall clock for p50/p99.
+# One line of key=value pairs is printed per workload.
+#
+# Script workloads run a generated script file instead, once cold (parsed, the script cache
+# is written) and once warm (loaded from the cache). The two lines differ in cache=.
+
+SHELL_BIN=${1:-./smallsh}
+COUNT=${2:-10000}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# streams of COUNT commands, one file per workload. /bin/true by path so the spawn path is measured, not the true builtin
+gen_fg_true() {
+	awk -v n="$COUNT" 'BEGIN { for (i = 0; i < n; i++) print "/bin/true" }'
+}
+
+gen_bg_sleep() {
+	# a last foreground sleep lets the final jobs exit so they are reaped before the stream ends
+	awk -v n="$COUNT" 'BEGIN { for (i = 0; i < n; i++) print "sleep 0 &"; print "sleep 0.2"; print "/bin/true" }'
+}
+
+gen_long_line() {
+	# words until the line is just under 2 KB, the old line limit
+	awk -v n="$COUNT" 'BEGIN {
+		line = "/bin/true"
+		for (i = 0; length(line) < 2000; i++) line = line sprintf(i % 8 ? " dir%d/file_%d.log" : " \"dir %d/file.log\"", i, i)
+		for (i = 0; i < n; i++) print line
+	}'
+}
+
+gen_pid_subst() {
+	awk -v n="$COUNT" 'BEGIN {
+		line = "/bin/true"
+		for (i = 0; i < 64; i++) line = line " /tmp/f.$$.$$"
+		for (i = 0; i < n; i++) print line
+	}'
+}
+
+# scripts of COUNT commands of builtins: a for loop that runs its body COUNT times, and the same body written out COUNT times
+gen_loop_script() {
+	echo "for i in \$(seq 1 $COUNT); do"
+	echo "	test \$i -gt 0 && true"
+	echo "done"
+}
+
+gen_flat_script() {
+	awk -v n="$COUNT" 'BEGIN { for (i = 1; i <= n; i++) print "test " i " -gt 0 && true" }'
+}
+
+# run one script workload cold and warm and print a result line for each
+run_script() {
+	name=$1
+	{ "gen_$name"; echo memstats; } > "$WORK/$name.sh"
+	rm -rf "$WORK/cache"
+	for cache in cold warm
+	do
+		start=$(date +%s%N)
+		SMALLSH_CACHE="$WORK/cache" "$SHELL_BIN" "$WORK/$name.sh" > "$WORK/$name.out" 2>/dev/null
+		end=$(date +%s%N)
+		rss=$(awk '/^rss:/ { print $5 }' "$WORK/$name.out")
+		awk -v name="$name" -v commands="$COUNT" -v ns="$((end - start))" -v rss="$rss" -v cache="$cache" 'BEGIN {
+			seconds = ns / 1e9
+			printf "workload=%s commands=%d seconds=%.3f cmds_per_sec=%.0f p50_us=NA p99_us=NA peak_rss_kb=%s cache=%s\n", name, commands, seconds, commands / seconds, rss, cache
+		}'
+	done
+}
+
+# run one workload and print its result line
+run_workload() {
+	name=$1
+	"gen_$name" > "$WORK/$name"
+	{ cat "$WORK/$name"; echo memstats; } > "$WORK/$name.plain"
+	sed 's/^/time /' "$WORK/$name" > "$WORK/$name.timed"
+	lines=$(wc -l < "$WORK/$name")
+
+	# throughput, wall clock of the whole stream
+	start=$(date +%s%N)
+	"$SHELL_BIN" < "$WORK/$name.plain" > "$WORK/$name.out" 2>/dev/null
+	end=$(date +%s%N)
+	rss=$(awk '/^rss:/ { print $5 }' "$WORK/$name.out")
+	reaped=$(grep -c 'is done' "$WORK/$name.out")
+
+	# latency, the time builtin reports real seconds of every command on stderr. background jobs are not timed
+	: > "$WORK/$name.times"
+	if [ "$name" != bg_sleep ]; then
+		"$SHELL_BIN" < "$WORK/$name.timed" 2> "$WORK/$name.times" > /dev/null
+	fi
+	awk '/^real / { printf "%.1f\n", $2 * 1e6 }' "$WORK/$name.times" | sort -n > "$WORK/$name.lat"
+	samples=$(wc -l < "$WORK/$name.lat")
+
+	awk -v name="$name" -v lines="$lines" -v ns="$((end - start))" -v rss="$rss" -v reaped="$reaped" -v samples="$samples" -v lat="$WORK/$name.lat" 'BEGIN {
+		p50 = p99 = "NA"
+		if (samples > 0) {
+			i50 = int(samples * 0.50); i99 = int(samples * 0.99)
+			if (i50 < 1) i50 = 1
+			if (i99 < 1) i99 = 1
+			for (i = 1; (getline v < lat) > 0; i++) {
+				if (i == i50) p50 = v
+				if (i == i99) p99 = v
+			}
+		}
+		seconds = ns / 1e9
+		printf "workload=%s commands=%d seconds=%.3f cmds_per_sec=%.0f p50_us=%s p99_us=%s peak_rss_kb=%s", name, lines, seconds, lines / seconds, p50, p99, rss
+		if (name == "bg_sleep") printf " reaped=%d", reaped
+		printf "\n"
+	}'
+}
+
+for workload in fg_true bg_sleep long_line pid_subst
+do
+	run_workload "$workload"
+done
+
+for script in loop_script flat_script
+do
+	run_script "$script"
+done
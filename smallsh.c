@@ -1,695 +1,8066 @@
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
 #include <fcntl.h>
+#include <sched.h>
 #include <signal.h>
+#include <spawn.h>
 #include <string.h>
 #include <stdbool.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/poll.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
 #include <unistd.h>
+#include <linux/mempolicy.h>
 
-#define MAX_CHAR_LENGTH 2048
-#define MAX_ARGUMENTS 512
+#define PATH_TABLE_SIZE 256
+#define ARENA_BLOCK_SIZE 8192
+#define BATCH_BUFFER_SIZE (1 << 16)
+#define FANOUT_PIPE_SIZE (1 << 20)
+#define FINISHED_JOB_COUNT 64
+#define STATS_TABLE_SIZE 256
+#define HISTOGRAM_BUCKETS (61 * 16)
+#define GLOB_BATCH_SIZE (256 * 1024)
+#define SERVER_PENDING_LIMIT (1 << 20)
+#define SERVER_LISTEN_EVENT UINT64_MAX
+#define SERVER_CHILD_EVENT (UINT64_MAX - 1)
+#define FUNCTION_TABLE_SIZE 64
+#define FUNCTION_DEPTH_LIMIT 1000
+#define SCRIPT_CACHE_MAGIC "smallsh script 1"
+#define SCRIPT_CACHE_DEPTH_LIMIT 10000
 
 /* 
 Global variables for
 1. Foreground only mode
 2. Signal termination number for foreground processes
+3. Pipefail mode, status of a pipeline comes from the rightmost failing stage
+4. Relay mode, the shell splices redirection files in and out of a pipeline
+5. Spawn mode, how child processes are started
+6. Placement policy, which cpus background jobs run on
 */
 bool FOREGROUND_ONLY = false;
 int SIGNAL_NUMBER;
+bool PIPEFAIL = false;
+bool SPLICE_RELAY = false;
+enum spawnMode { SPAWN_FORK, SPAWN_VFORK, SPAWN_POSIX_SPAWN } SPAWN_MODE = SPAWN_POSIX_SPAWN;
 
-/* A linked list struct to store terminal command  for user */
-struct command
+/* names of the spawn modes for set spawn=, in enum order */
+char* SPAWN_MODE_NAMES[] = { "fork", "vfork", "posix_spawn" };
+
+enum placementPolicy { PLACEMENT_NONE, PLACEMENT_ROUNDROBIN, PLACEMENT_COMPACT, PLACEMENT_NUMA } PLACEMENT = PLACEMENT_NONE;
+
+/* names of the placement policies for set placement=, in enum order */
+char* PLACEMENT_NAMES[] = { "none", "roundrobin", "compact", "numa" };
+
+// pid of the shell as a string, $$ is replaced with it
+char PID_STRING[16];
+
+// status of the last command for $? and pid of the last background job for $!, 0 until there is one
+int LAST_STATUS = 0;
+pid_t LAST_BACKGROUND_PID = 0;
+
+// arguments of the script or of the function that runs, $1 to $9, $# and $@
+char** POSITIONAL_ARGS = NULL;
+int POSITIONAL_COUNT = 0;
+
+// set by ^C while a loop runs in the shell, a loop of builtins has no child the signal could stop
+volatile sig_atomic_t LOOP_INTERRUPTED = 0;
+
+// prompt of the line editor, "> " while a for, while or function goes on over more lines
+const char* PROMPT = ": ";
+
+/* A block of arena memory, blocks are chained and kept for reuse */
+struct arenaBlock
+{
+	struct arenaBlock* next;
+	size_t size;
+	size_t used;
+	char data[];
+};
+
+/* A bump allocator for everything parsed from one command line, reset once the command is done */
+struct arena
+{
+	struct arenaBlock* first;
+	struct arenaBlock* current;
+	struct arenaBlock* last;
+	size_t inUse;
+	size_t highWater;
+	size_t reserved;
+	size_t allocations;
+	size_t totalBytes;
+	long resets;
+};
+
+/* A place in an arena, everything allocated after it can be given back at once */
+struct arenaMark
+{
+	struct arenaBlock* block;
+	size_t used;
+	size_t inUse;
+};
+
+/* A redirection of one pipeline stage, fd 0 reads from path and fd 1 writes to it */
+struct redirection
+{
+	int fd;
+	char* path;
+	bool append;
+};
+
+/* A struct to hold one stage of a pipeline, the argv and redirections of a single command */
+struct pipelineStage
+{
+	char** argv;
+	int argc;
+	struct redirection* redirections;
+	int redirectionCount;
+};
+
+/* A command line after tokenizing, the stages of its pipeline and whether it runs in background. error is set if the line cannot run */
+struct parsedCommand
+{
+	struct pipelineStage* stages;
+	int stageCount;
+	int argumentCount;
+	bool background;
+	cpu_set_t* cpus;
+	char* error;
+};
+
+/* Where one stage starts in the arrays of the tokenizer, the arrays can still move while the line is read */
+struct stageSpan
+{
+	int firstWord;
+	int argc;
+	int firstRedirection;
+	int redirectionCount;
+};
+
+/* State of the tokenizer while it reads one command line */
+struct tokenizer
+{
+	struct arena* arena;
+	char* text;
+	int textLength;
+	int textCapacity;
+	int wordStart;
+	char** words;
+	int wordCount;
+	int wordCapacity;
+	struct redirection* redirections;
+	int redirectionCount;
+	int redirectionCapacity;
+	struct stageSpan* stages;
+	int stageCount;
+	int stageCapacity;
+	struct stageSpan current;
+	int argumentCount;
+	int pendingRedirection;
+	bool pendingAppend;
+	bool wordLiteral;
+	bool wordSplit;
+	int* globOffsets;
+	int globCount;
+	int globCapacity;
+	char* error;
+};
+
+/* State of the parser of a command list: where it is in the text and the error of what it read. incomplete is set along with the error
+   when the text ends inside a for, while or function or right after && or ||, more lines can finish it */
+struct listParser
+{
+	struct arena* arena;
+	const char* c;
+	char* error;
+	bool incomplete;
+};
+
+/* The start of a script cache file, what the script was when it was parsed. the path of the script and its items come after it */
+struct scriptCacheHeader
+{
+	char magic[16];
+	uint64_t device;
+	uint64_t inode;
+	uint64_t size;
+	int64_t seconds;
+	int64_t nanoseconds;
+	uint32_t count;
+};
+
+/* Where loading a script cache file is, bad is set once something in it does not fit */
+struct cacheReader
+{
+	const char* next;
+	const char* end;
+	bool bad;
+};
+
+/* One step of a compiled glob: 'c' is the character c, '?' any one character, '*' any run of them and '[' a class, a bitmap of the bytes it takes */
+struct globToken
+{
+	char type;
+	unsigned char c;
+	unsigned char set[32];
+};
+
+/* A part of a glob pattern between slashes, compiled once for every name of the directories it is matched in. name is the part as written,
+   hiddenToo is set if it starts with a . so names that start with one can match */
+struct globComponent
+{
+	struct globToken* tokens;
+	int count;
+	char* name;
+	bool hiddenToo;
+};
+
+/* Paths a glob matched so far, the strings live in the arena */
+struct globMatches
+{
+	char** paths;
+	int count;
+	int capacity;
+};
+
+/* A directory entry the way getdents64 returns them, one after the other in a batch */
+struct linuxDirent64
+{
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+/* A linked list struct for one bucket of the command table, maps a command name to where it was found on PATH */
+struct pathEntry
+{
+	char* name;
+	char* path;
+	int dirIndex;
+	int hits;
+	struct pathEntry* next;
+};
+
+/* Hash table of commands found on PATH, with the PATH and directory mtimes it is valid for */
+struct pathCache
+{
+	struct pathEntry* buckets[PATH_TABLE_SIZE];
+	char* pathCopy;
+	char* dirBuffer;
+	char** dirs;
+	struct timespec* dirMtimes;
+	int dirCount;
+	char* lastRelative;
+	long hits;
+	long misses;
+	long execsSaved;
+};
+
+// the command table, filled on first use of every command
+struct pathCache PATH_CACHE = {0};
+
+/* An entry of the job table, one per background process. next chains entries of a pid bucket or the free list.
+   every process of a pipeline has the job number and process group of the pipeline, the last stage also has its command.
+   a job that was placed has the cpus it ran on, its NUMA node and when it started */
+struct job
+{
+	pid_t pid;
+	bool silent;
+	int next;
+	int number;
+	pid_t group;
+	bool stopped;
+	char* command;
+	cpu_set_t* cpus;
+	int node;
+	struct timespec started;
+};
+
+/* Table of background processes keyed by pid, entries of finished jobs are recycled */
+struct jobTable
+{
+	struct job* jobs;
+	int* buckets;
+	int capacity;
+	int count;
+	int freeList;
+};
+
+// the job table and the signalfd that reports child exits
+struct jobTable JOB_TABLE = { NULL, NULL, 0, 0, -1 };
+int SIGCHLD_FD = -1;
+
+/* A background job that is done, kept so wait still gets its status after the prompt reaped it */
+struct finishedJob
+{
+	pid_t pid;
+	int number;
+	int status;
+	int signalNumber;
+};
+
+// the last jobs that finished, FINISHED_JOB_COUNT of them in a ring
+struct finishedJob FINISHED_JOBS[FINISHED_JOB_COUNT];
+unsigned long FINISHED_COUNT = 0;
+
+/* The last size bytes a background job wrote to stdout and stderr, total counts all of them. filled by the capture thread from fd,
+   open until the job closes its end. the list is changed by the shell only, CAPTURE_LOCK guards it and the bytes */
+struct outputRing
+{
+	int fd;
+	int number;
+	pid_t pid;
+	char* data;
+	size_t size;
+	unsigned long long total;
+	bool open;
+	struct outputRing* next;
+};
+
+// bytes kept of every background job, 0 sends their output to /dev/null. rings newest first and the epoll fd of the capture thread
+size_t CAPTURE_SIZE = 0;
+struct outputRing* CAPTURE_RINGS = NULL;
+int CAPTURE_EPOLL_FD = -1;
+pthread_mutex_t CAPTURE_LOCK = PTHREAD_MUTEX_INITIALIZER;
+
+/* Where a job runs: the cpus it may use and the NUMA node its memory should come from, -1 for any */
+struct placement
+{
+	cpu_set_t cpus;
+	int node;
+};
+
+/* Affinity and memory policy of the shell from before a placement, put back once the processes are started */
+struct savedPlacement
+{
+	cpu_set_t cpus;
+	bool memory;
+	int memoryMode;
+	unsigned long nodeMask[16];
+};
+
+/* The cpus the shell may use and how they split into NUMA nodes, read on first use. nextCpu is where round robin goes on */
+struct cpuTopology
+{
+	bool loaded;
+	cpu_set_t allowed;
+	int nodeCount;
+	int* nodeIds;
+	cpu_set_t* nodeCpus;
+	int nextCpu;
+};
+
+// the topology, loaded by the first placement
+struct cpuTopology TOPOLOGY = {0};
+
+/* What the last foreground job used, summed over its stages. count goes up with every job */
+struct jobUsage
+{
+	char command[64];
+	int stageCount;
+	struct timespec wall;
+	struct rusage usage;
+	unsigned long count;
+};
+
+// usage of the last foreground job, shown by status -v and time
+struct jobUsage LAST_USAGE = {0};
+
+/* Count, failures and a latency histogram of every command with one name, for stats. next chains a bucket of the table */
+struct commandStats
+{
+	char* name;
+	unsigned long count;
+	unsigned long failures;
+	unsigned int buckets[HISTOGRAM_BUCKETS];
+	struct commandStats* next;
+};
+
+// stats of every command name, and the metrics log every command is appended to, -1 if there is none
+struct commandStats* COMMAND_STATS[STATS_TABLE_SIZE] = {0};
+int METRICS_FD = -1;
+char* METRICS_PATH = NULL;
+
+/* One command run by the parallel builtin, its output is kept until it can be printed */
+struct parallelJob
+{
+	char* command;
+	pid_t* pids;
+	int* stageStatus;
+	int* stageSignal;
+	int stageCount;
+	int running;
+	int outputFD;
+	char* output;
+	size_t outputLength;
+	size_t outputCapacity;
+	int status;
+	int signalNumber;
+	bool done;
+	bool printed;
+};
+
+/* One command of the history, where its text starts in the history file and how long it is */
+struct historyEntry
+{
+	size_t start;
+	unsigned int length;
+};
+
+/* Entries of the history that contain one trigram, ids go up */
+struct trigramPosting
+{
+	unsigned int trigram;
+	unsigned int count;
+	unsigned int capacity;
+	unsigned int* ids;
+};
+
+/* The history file mapped into memory, with the start of every entry and a trigram index for substring search.
+both indexes are built when first needed and only ever extended, other shells append to the same file */
+struct history
+{
+	int fd;
+	char* map;
+	size_t mapSize;
+	size_t indexedBytes;
+	struct historyEntry* entries;
+	unsigned int count;
+	unsigned int capacity;
+	struct trigramPosting* postings;
+	unsigned int postingSlots;
+	unsigned int postingsUsed;
+	unsigned int trigramIndexed;
+};
+
+// the history, fd is -1 when there is no history file
+struct history HISTORY = { -1 };
+
+/* A node of the command name trie. children of a node are a list of siblings sorted by character, names counts the commands at and below the node */
+struct trieNode
+{
+	int firstChild;
+	int nextSibling;
+	int names;
+	unsigned char c;
+	bool terminal;
+};
+
+/* Every executable on PATH and every builtin in a trie for Tab completion, with the PATH and directory mtimes it was built from */
+struct commandTrie
+{
+	struct trieNode* nodes;
+	int count;
+	int capacity;
+	char* pathCopy;
+	struct timespec* dirMtimes;
+	int dirCount;
+};
+
+// the command trie, built on the first Tab
+struct commandTrie COMMAND_TRIE = {0};
+
+/* Sorted names in the directory files were last completed in, good while the directory has the same inode and mtime */
+struct directoryCache
+{
+	dev_t device;
+	ino_t inode;
+	struct timespec mtime;
+	char** names;
+	bool* isDirectory;
+	int count;
+	bool loaded;
+};
+
+// the directory listing, read again only when the directory changed
+struct directoryCache DIRECTORY_CACHE = {0};
+
+/* A client of the server: its socket, the pipes of the shell that runs its commands and the frames still to be sent to it.
+   the shell is a fork of the server, so every client has its own working directory, status and job table. gone is set when the client hung up */
+struct serverClient
+{
+	int socketFD;
+	int outputFD;
+	int errorFD;
+	int statusFD;
+	pid_t shell;
+	int exitStatus;
+	char* pending;
+	size_t pendingStart;
+	size_t pendingLength;
+	size_t pendingCapacity;
+	bool throttled;
+	bool gone;
+};
+
+// in the shell of a server client, where the status of every command is written. -1 otherwise
+int SERVER_STATUS_FD = -1;
+
+/* A buffered reader for command lines from a terminal, a pipe, a mapped script or a -c string. an interactive reader waits for input and child exits at the same time */
+struct lineReader
+{
+	int fd;
+	char* buffer;
+	size_t capacity;
+	size_t start;
+	size_t end;
+	bool eof;
+	bool interactive;
+	bool mapped;
+};
+
+/* What builtins see of the shell: status of the last command, the arena of the command line and where commands are read from. exit sets exiting,
+   exitOnError is -e. break, continue and return set jump, the commands after them are skipped up to the loop or function it leaves.
+   jumpLevels is how many loops break and continue leave, loopDepth and functionDepth how many run right now. inputRedirected is set while
+   a builtin runs with stdin from a < file instead of the input of the shell */
+enum jumpType { JUMP_NONE, JUMP_BREAK, JUMP_CONTINUE, JUMP_RETURN };
+struct shellState
+{
+	int status;
+	struct arena* arena;
+	struct lineReader* input;
+	bool exiting;
+	bool exitOnError;
+	enum jumpType jump;
+	int jumpLevels;
+	int loopDepth;
+	int functionDepth;
+	bool inputRedirected;
+};
+
+/* A command line split at ; & && and ||: a command, or two nodes joined by one of them. a command is tokenized only when it runs,
+   so its expansions see what the commands before it did. text is the part of the line the node covers, background is set by a & after it.
+   for runs right for every one of words with the variable name set to it, while and until run left as the condition and right as the body,
+   a function node defines name with right as its body */
+enum nodeType { NODE_COMMAND, NODE_SEQUENCE, NODE_AND, NODE_OR, NODE_FOR, NODE_WHILE, NODE_UNTIL, NODE_FUNCTION };
+struct commandNode
+{
+	enum nodeType type;
+	char* text;
+	bool background;
+	char* name;
+	char* words;
+	struct commandNode* left;
+	struct commandNode* right;
+};
+
+/* A function of the shell, its body is a copy of the tree that lives as long as the shell. next chains a bucket of the table */
+struct shellFunction
+{
+	char* name;
+	struct commandNode* body;
+	struct shellFunction* next;
+};
+
+// every function defined so far by name, and the arena their bodies live in
+struct shellFunction* FUNCTIONS[FUNCTION_TABLE_SIZE] = {0};
+struct arena FUNCTION_ARENA = {0};
+
+/* A script file parsed as a whole, one item per command line: its tree, or the error of a line that cannot run, and where the line
+   starts and ends in the file. it is what the script cache keeps, next is the item the shell runs next */
+struct scriptItem
+{
+	struct commandNode* list;
+	char* error;
+	size_t start;
+	size_t end;
+};
+struct parsedScript
+{
+	struct scriptItem* items;
+	int count;
+	int next;
+	struct arena arena;
+};
+
+/* A builtin command. replacesProgram marks the ones that stand in for a program on PATH, those run in the shell only when alone in the foreground */
+struct builtin
+{
+	char* name;
+	int (*run)(char* argv[], struct shellState* shell);
+	bool replacesProgram;
+};
+
+// function to get memory for the current command line from the arena, memory lives until the arena is reset
+void* arenaAlloc(struct arena* arena, size_t size)
+{
+	// keep every allocation aligned for any type
+	size = (size + 15) & ~(size_t)15;
+
+	// move on to the next block until one has room, blocks of earlier lines are reused
+	while (arena->current != NULL && arena->current->used + size > arena->current->size)
+	{
+		arena->current = arena->current->next;
+	}
+
+	// no block has room, from heap generate a new one big enough for this allocation
+	if (arena->current == NULL)
+	{
+		size_t blockSize = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+		struct arenaBlock* block = malloc(sizeof(struct arenaBlock) + blockSize);
+		block->size = blockSize;
+		block->used = 0;
+		block->next = NULL;
+
+		// put the block at the end of the chain
+		if (arena->last != NULL) {
+			arena->last->next = block;
+		}
+		else {
+			arena->first = block;
+		}
+		arena->last = block;
+		arena->current = block;
+		arena->reserved += blockSize;
+	}
+
+	// bump the block
+	void* memory = arena->current->data + arena->current->used;
+	arena->current->used += size;
+	arena->inUse += size;
+	arena->allocations++;
+	arena->totalBytes += size;
+	if (arena->inUse > arena->highWater) {
+		arena->highWater = arena->inUse;
+	}
+	return memory;
+}
+
+// function to give every block of the arena back to the heap, for arenas that are not reused
+void arenaRelease(struct arena* arena)
+{
+	while (arena->first != NULL)
+	{
+		struct arenaBlock* block = arena->first;
+		arena->first = block->next;
+		free(block);
+	}
+	arena->current = NULL;
+	arena->last = NULL;
+	arena->inUse = 0;
+	arena->reserved = 0;
+}
+
+// function to copy a string into the arena
+char* arenaStrdup(struct arena* arena, const char* s)
+{
+	size_t len = strlen(s);
+	char* copy = arenaAlloc(arena, len + 1);
+	memcpy(copy, s, len + 1);
+	return copy;
+}
+
+// function to give back everything allocated from the arena at once, the blocks are kept for the next line
+void arenaReset(struct arena* arena)
+{
+	for (struct arenaBlock* block = arena->first; block != NULL; block = block->next)
+	{
+		block->used = 0;
+	}
+	arena->current = arena->first;
+	arena->inUse = 0;
+	arena->resets++;
+}
+
+// function to remember how far the arena is filled, for arenaRewind
+struct arenaMark arenaSave(struct arena* arena)
+{
+	struct arenaMark mark = { arena->current, arena->current != NULL ? arena->current->used : 0, arena->inUse };
+	return mark;
+}
+
+// function to give back everything allocated since mark, like arenaReset for the part of a line a loop runs again
+void arenaRewind(struct arena* arena, struct arenaMark* mark)
+{
+	struct arenaBlock* block = mark->block != NULL ? mark->block : arena->first;
+	if (block == NULL) {
+		return;
+	}
+	block->used = mark->block != NULL ? mark->used : 0;
+	for (struct arenaBlock* later = block->next; later != NULL; later = later->next)
+	{
+		later->used = 0;
+	}
+	arena->current = block;
+	arena->inUse = mark->inUse;
+}
+
+// function to grow an array that lives in the arena, the old copy is left behind until the arena is reset
+void* arenaGrow(struct arena* arena, void* array, size_t oldSize, size_t newSize)
+{
+	void* grown = arenaAlloc(arena, newSize);
+	if (oldSize > 0) {
+		memcpy(grown, array, oldSize);
+	}
+	return grown;
+}
+
+// function to append a character to the word being tokenized, the text buffer moves to a bigger one when full
+void appendToWord(struct tokenizer* tok, char c)
+{
+	if (tok->textLength == tok->textCapacity)
+	{
+		// only the word in progress moves, finished words stay where argv points at them
+		int wordLength = tok->textLength - tok->wordStart;
+		tok->textCapacity = wordLength * 2 + 64;
+		tok->text = arenaGrow(tok->arena, tok->text + tok->wordStart, wordLength, tok->textCapacity);
+		tok->textLength = wordLength;
+		tok->wordStart = 0;
+	}
+	tok->text[tok->textLength++] = c;
+}
+
+// function to append a string to the word being tokenized
+void appendStringToWord(struct tokenizer* tok, const char* s)
+{
+	while (*s) {
+		appendToWord(tok, *s++);
+	}
+}
+
+// function to add a pointer to the argv array of the command line
+void addWord(struct tokenizer* tok, char* word)
+{
+	if (tok->wordCount == tok->wordCapacity) {
+		tok->wordCapacity = tok->wordCapacity * 2 + 16;
+		tok->words = arenaGrow(tok->arena, tok->words, tok->wordCount * sizeof(char*), tok->wordCapacity * sizeof(char*));
+	}
+	tok->words[tok->wordCount++] = word;
+}
+
+// function to close the current stage, its argv ends with the NULL that execv wants
+void endStage(struct tokenizer* tok)
+{
+	if (tok->stageCount == tok->stageCapacity) {
+		tok->stageCapacity = tok->stageCapacity * 2 + 4;
+		tok->stages = arenaGrow(tok->arena, tok->stages, tok->stageCount * sizeof(struct stageSpan), tok->stageCapacity * sizeof(struct stageSpan));
+	}
+	tok->stages[tok->stageCount++] = tok->current;
+	addWord(tok, NULL);
+
+	// next stage starts after the NULL
+	tok->current.firstWord = tok->wordCount;
+	tok->current.argc = 0;
+	tok->current.firstRedirection = tok->redirectionCount;
+	tok->current.redirectionCount = 0;
+}
+
+// function to append length bytes to the word being tokenized, the text buffer grows once for all of them
+void appendBytesToWord(struct tokenizer* tok, const char* s, int length)
+{
+	if (tok->textLength + length > tok->textCapacity)
+	{
+		int wordLength = tok->textLength - tok->wordStart;
+		tok->textCapacity = (wordLength + length) * 2 + 64;
+		tok->text = arenaGrow(tok->arena, tok->text + tok->wordStart, wordLength, tok->textCapacity);
+		tok->textLength = wordLength;
+		tok->wordStart = 0;
+	}
+	memcpy(tok->text + tok->textLength, s, length);
+	tok->textLength += length;
+}
+
+// function to give a finished word to the stage, as the file of a pending redirection or as the next argument
+void takeWord(struct tokenizer* tok, char* word)
+{
+	if (tok->pendingRedirection != -1) {
+		if (tok->redirectionCount == tok->redirectionCapacity) {
+			tok->redirectionCapacity = tok->redirectionCapacity * 2 + 4;
+			tok->redirections = arenaGrow(tok->arena, tok->redirections, tok->redirectionCount * sizeof(struct redirection), tok->redirectionCapacity * sizeof(struct redirection));
+		}
+		tok->redirections[tok->redirectionCount].fd = tok->pendingRedirection;
+		tok->redirections[tok->redirectionCount].path = word;
+		tok->redirections[tok->redirectionCount].append = tok->pendingAppend;
+		tok->redirectionCount++;
+		tok->current.redirectionCount++;
+		tok->pendingRedirection = -1;
+	}
+	else {
+		addWord(tok, word);
+		tok->current.argc++;
+		tok->argumentCount++;
+	}
+}
+
+// function to append text that is split into words, like unquoted output of $(command): every run of white space ends a word,
+// a word is only started by what is not white space
+void splitIntoWords(struct tokenizer* tok, const char* text, size_t length)
+{
+	tok->wordSplit = true;
+	size_t i = 0;
+	while (i < length && tok->error == NULL)
+	{
+		size_t start = i;
+		while (i < length && text[i] != ' ' && text[i] != '\t' && text[i] != '\n') {
+			i++;
+		}
+		appendBytesToWord(tok, text + start, i - start);
+		if (i == length) {
+			break;
+		}
+
+		// the word so far is done, the rest of the text starts the next one
+		if (tok->textLength > tok->wordStart || tok->wordLiteral) {
+			if (tok->pendingRedirection != -1) {
+				tok->error = "Ambiguous redirection in command line!";
+				break;
+			}
+			appendToWord(tok, '\0');
+			takeWord(tok, tok->text + tok->wordStart);
+			tok->wordStart = tok->textLength;
+			tok->wordLiteral = false;
+			tok->globCount = 0;
+		}
+		while (i < length && (text[i] == ' ' || text[i] == '\t' || text[i] == '\n')) {
+			i++;
+		}
+	}
+}
+
+// function to note that the character about to be appended is an unquoted * ? or [, only those make a word a pattern
+void markGlobCharacter(struct tokenizer* tok)
+{
+	if (tok->globCount == tok->globCapacity) {
+		tok->globCapacity = tok->globCapacity * 2 + 8;
+		tok->globOffsets = arenaGrow(tok->arena, tok->globOffsets, tok->globCount * sizeof(int), tok->globCapacity * sizeof(int));
+	}
+	tok->globOffsets[tok->globCount++] = tok->textLength - tok->wordStart;
+}
+
+// function to find the ) that ends the ( at c, quotes and nested ( ) are skipped. NULL if there is none
+const char* substitutionEnd(const char* c)
+{
+	int depth = 0;
+	for (; *c; c++)
+	{
+		if (*c == '\'') {
+			c = strchr(c + 1, '\'');
+			if (c == NULL) {
+				return NULL;
+			}
+		}
+		else if (*c == '"') {
+			for (c++; *c && *c != '"'; c++) {
+				if (*c == '\\' && c[1] != '\0') {
+					c++;
+				}
+			}
+			if (*c == '\0') {
+				return NULL;
+			}
+		}
+		else if (*c == '\\' && c[1] != '\0') {
+			c++;
+		}
+		else if (*c == '(') {
+			depth++;
+		}
+		else if (*c == ')' && --depth == 0) {
+			return c;
+		}
+	}
+	return NULL;
+}
+
+// function to expand $(command) at c, defined with the code that runs commands
+const char* substituteCommand(struct tokenizer* tok, const char* c, bool quoted);
+
+// function to expand the $ that c points at: $$, $?, $!, $1 to $9, $#, $@, $*, $NAME, ${NAME} or $(command). the value goes straight into the word,
+// returns where the expansion ends. output of a command and $@ are split into words unless they are quoted
+const char* expandDollar(struct tokenizer* tok, const char* c, bool quoted)
+{
+	char number[24];
+
+	// $(command) runs the command and takes what it writes
+	if (c[1] == '(') {
+		return substituteCommand(tok, c, quoted);
+	}
+
+	// $$ is the pid of the shell, cached at startup
+	if (c[1] == '$') {
+		appendStringToWord(tok, PID_STRING);
+		return c + 2;
+	}
+	// $? is the status of the last command, 128 + signal if it was killed like the exit code of the shell
+	if (c[1] == '?') {
+		sprintf(number, "%d", LAST_STATUS);
+		appendStringToWord(tok, number);
+		return c + 2;
+	}
+	// $! is the pid of the last background job, empty if there was none
+	if (c[1] == '!') {
+		if (LAST_BACKGROUND_PID != 0) {
+			sprintf(number, "%d", LAST_BACKGROUND_PID);
+			appendStringToWord(tok, number);
+		}
+		return c + 2;
+	}
+
+	// $1 to $9 are the arguments of the script or function, $# how many there are
+	if (c[1] >= '1' && c[1] <= '9') {
+		if (c[1] - '0' <= POSITIONAL_COUNT) {
+			appendStringToWord(tok, POSITIONAL_ARGS[c[1] - '1']);
+		}
+		return c + 2;
+	}
+	if (c[1] == '#') {
+		sprintf(number, "%d", POSITIONAL_COUNT);
+		appendStringToWord(tok, number);
+		return c + 2;
+	}
+	// $@ and $* are all of them with a space between, unquoted every argument is a word of its own again
+	if (c[1] == '@' || c[1] == '*') {
+		for (int i = 0; i < POSITIONAL_COUNT; i++)
+		{
+			const char* separator = i > 0 ? " " : "";
+			if (quoted) {
+				appendStringToWord(tok, separator);
+				appendStringToWord(tok, POSITIONAL_ARGS[i]);
+			}
+			else {
+				splitIntoWords(tok, separator, strlen(separator));
+				splitIntoWords(tok, POSITIONAL_ARGS[i], strlen(POSITIONAL_ARGS[i]));
+			}
+		}
+		tok->wordSplit = tok->wordSplit || (!quoted && POSITIONAL_COUNT == 0);
+		return c + 2;
+	}
+
+	// a name is a letter or _ followed by letters, digits and _, in braces it ends at the }
+	bool braces = (c[1] == '{');
+	const char* name = c + (braces ? 2 : 1);
+	size_t length = 0;
+	if (isalpha((unsigned char)name[0]) || name[0] == '_') {
+		while (isalnum((unsigned char)name[length]) || name[length] == '_') {
+			length++;
+		}
+	}
+
+	// a $ that starts nothing stays as it is
+	if (length == 0 && !braces) {
+		appendToWord(tok, '$');
+		return c + 1;
+	}
+	if (braces && (length == 0 || name[length] != '}')) {
+		tok->error = "Bad variable substitution in command line!";
+		return name + length;
+	}
+
+	// unset variables expand to nothing
+	char* copy = arenaAlloc(tok->arena, length + 1);
+	memcpy(copy, name, length);
+	copy[length] = '\0';
+	char* value = getenv(copy);
+	if (value != NULL) {
+		appendStringToWord(tok, value);
+	}
+	return name + length + (braces ? 1 : 0);
+}
+
+// function to read one word starting at c, quotes and backslashes are removed and variables are expanded. returns where the word ends.
+// words split off by $(command) are taken as they end. wordLiteral is set by quotes and characters of the word itself, wordSplit by unquoted $(command)
+const char* readWord(struct tokenizer* tok, const char* c)
+{
+	tok->wordStart = tok->textLength;
+	tok->wordLiteral = false;
+	tok->wordSplit = false;
+	tok->globCount = 0;
+
+	// a word ends at unquoted white space or an operator
+	while (*c && strchr(" \t\n|<>", *c) == NULL)
+	{
+		// single quotes keep everything as it is
+		if (*c == '\'') {
+			tok->wordLiteral = true;
+			for (c++; *c && *c != '\''; c++) {
+				appendToWord(tok, *c);
+			}
+			if (*c == '\0') {
+				tok->error = "Missing closing quote in command line!";
+				return c;
+			}
+			c++;
+		}
+		// double quotes keep white space and operators, backslash only escapes \ " and $
+		else if (*c == '"') {
+			tok->wordLiteral = true;
+			for (c++; *c && *c != '"'; c++) {
+				if (*c == '\\' && (c[1] == '\\' || c[1] == '"' || c[1] == '$')) {
+					appendToWord(tok, *++c);
+				}
+				else if (*c == '$') {
+					c = expandDollar(tok, c, true) - 1;
+					if (tok->error != NULL) {
+						return c;
+					}
+				}
+				else {
+					appendToWord(tok, *c);
+				}
+			}
+			if (*c == '\0') {
+				tok->error = "Missing closing quote in command line!";
+				return c;
+			}
+			c++;
+		}
+		// backslash keeps the next character as it is
+		else if (*c == '\\' && c[1] != '\0') {
+			tok->wordLiteral = true;
+			appendToWord(tok, c[1]);
+			c += 2;
+		}
+		// $ starts an expansion outside single quotes
+		else if (*c == '$') {
+			c = expandDollar(tok, c, false);
+			if (tok->error != NULL) {
+				return c;
+			}
+		}
+		// unquoted * ? and [ make the word a pattern
+		else {
+			if (*c == '*' || *c == '?' || *c == '[') {
+				markGlobCharacter(tok);
+			}
+			tok->wordLiteral = true;
+			appendToWord(tok, *c++);
+		}
+	}
+	appendToWord(tok, '\0');
+	return c;
+}
+
+// function to compare two names for qsort
+int compareNames(const void* a, const void* b)
+{
+	return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// function to compile one part of a pattern between slashes, from start up to end of the word. active tells which characters are unquoted * ? [.
+// a [ without its ] is a plain character. returns false if the part has no * ? or [ at all, it is a plain name then
+bool compileGlobComponent(struct arena* arena, const char* word, int start, int end, const bool* active, struct globComponent* component)
+{
+	component->tokens = arenaAlloc(arena, (end - start + 1) * sizeof(struct globToken));
+	component->count = 0;
+	component->name = arenaAlloc(arena, end - start + 1);
+	memcpy(component->name, word + start, end - start);
+	component->name[end - start] = '\0';
+	component->hiddenToo = word[start] == '.';
+	bool pattern = false;
+
+	for (int i = start; i < end; i++)
+	{
+		struct globToken* token = &component->tokens[component->count++];
+		token->type = 'c';
+		token->c = word[i];
+		if (!active[i]) {
+			continue;
+		}
+		if (word[i] == '*') {
+			token->type = '*';
+			pattern = true;
+			// a run of stars is one star
+			if (component->count > 1 && token[-1].type == '*') {
+				component->count--;
+			}
+		}
+		else if (word[i] == '?') {
+			token->type = '?';
+			pattern = true;
+		}
+		else if (word[i] == '[') {
+			// ! or ^ turns the class around, a ] right after the [ is part of it
+			int j = i + 1;
+			bool negate = j < end && (word[j] == '!' || word[j] == '^');
+			j += negate;
+			int first = j;
+			while (j < end && (word[j] != ']' || j == first)) {
+				j++;
+			}
+			if (j >= end) {
+				continue;
+			}
+			token->type = '[';
+			memset(token->set, 0, sizeof(token->set));
+			for (int k = first; k < j; k++)
+			{
+				unsigned char low = word[k], high = word[k];
+				if (k + 2 < j && word[k + 1] == '-') {
+					high = word[k + 2];
+					k += 2;
+				}
+				for (int b = low; b <= high; b++) {
+					token->set[b >> 3] |= 1 << (b & 7);
+				}
+			}
+			if (negate) {
+				for (int b = 0; b < 32; b++) {
+					token->set[b] = ~token->set[b];
+				}
+			}
+			pattern = true;
+			i = j;
+		}
+	}
+	return pattern;
+}
+
+// function to match a name against a compiled part of a pattern, a * that fails is retried one character further on
+bool globMatch(struct globComponent* component, const char* name)
+{
+	const unsigned char* n = (const unsigned char*)name;
+	const unsigned char* starName = NULL;
+	int t = 0, starToken = -1;
+	while (*n)
+	{
+		struct globToken* token = t < component->count ? &component->tokens[t] : NULL;
+		if (token != NULL && token->type == '*') {
+			starToken = ++t;
+			starName = n;
+			continue;
+		}
+		if (token != NULL && (token->type == '?' || (token->type == 'c' && token->c == *n) || (token->type == '[' && (token->set[*n >> 3] & (1 << (*n & 7)))))) {
+			t++;
+			n++;
+			continue;
+		}
+		if (starToken == -1) {
+			return false;
+		}
+		t = starToken;
+		n = ++starName;
+	}
+	while (t < component->count && component->tokens[t].type == '*') {
+		t++;
+	}
+	return t == component->count;
+}
+
+// function to add a path to the matches of a glob, the array grows on the heap
+void addGlobMatch(struct globMatches* matches, char* path)
+{
+	if (matches->count == matches->capacity) {
+		matches->capacity = matches->capacity ? matches->capacity * 2 : 64;
+		matches->paths = realloc(matches->paths, matches->capacity * sizeof(char*));
+	}
+	matches->paths[matches->count++] = path;
+}
+
+// function to read the directory prefix (the current one if it is empty) in big getdents64 batches and add prefix + every name that matches.
+// a match that has more parts of the pattern after it must be a directory and gets a /, only links and unknown types need a stat for that
+void scanGlobDirectory(struct arena* arena, const char* prefix, struct globComponent* component, bool directoriesOnly, struct globMatches* matches)
+{
+	static char* batch = NULL;
+	if (batch == NULL) {
+		batch = malloc(GLOB_BATCH_SIZE);
+	}
+	int directoryFD = open(*prefix ? prefix : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (directoryFD == -1) {
+		return;
+	}
+	size_t prefixLength = strlen(prefix);
+	long got;
+	while ((got = syscall(SYS_getdents64, directoryFD, batch, GLOB_BATCH_SIZE)) > 0)
+	{
+		for (long offset = 0; offset < got;)
+		{
+			struct linuxDirent64* entry = (struct linuxDirent64*)(batch + offset);
+			offset += entry->d_reclen;
+			const char* name = entry->d_name;
+
+			// . and .. never match, other hidden names only a pattern that starts with . does
+			if (name[0] == '.' && (!component->hiddenToo || name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+				continue;
+			}
+			if (!globMatch(component, name)) {
+				continue;
+			}
+			if (directoriesOnly && entry->d_type != DT_DIR) {
+				struct stat entryStat;
+				if ((entry->d_type != DT_LNK && entry->d_type != DT_UNKNOWN) || fstatat(directoryFD, name, &entryStat, 0) == -1 || !S_ISDIR(entryStat.st_mode)) {
+					continue;
+				}
+			}
+			size_t nameLength = strlen(name);
+			char* path = arenaAlloc(arena, prefixLength + nameLength + 2);
+			memcpy(path, prefix, prefixLength);
+			memcpy(path + prefixLength, name, nameLength);
+			path[prefixLength + nameLength] = directoriesOnly ? '/' : '\0';
+			path[prefixLength + nameLength + 1] = '\0';
+			addGlobMatch(matches, path);
+		}
+	}
+	close(directoryFD);
+}
+
+// function to expand the word just read if it has unquoted * ? or [, one directory scan per part of the pattern for every directory matched so far.
+// the sorted matches become arguments, returns how many. 0 leaves the word as it is
+int expandGlob(struct tokenizer* tok)
+{
+	char* word = tok->text + tok->wordStart;
+	int length = strlen(word);
+	bool* active = arenaAlloc(tok->arena, length + 1);
+	memset(active, 0, length + 1);
+	for (int i = 0; i < tok->globCount; i++) {
+		if (tok->globOffsets[i] < length) {
+			active[tok->globOffsets[i]] = true;
+		}
+	}
+
+	// an absolute pattern starts at the root
+	struct globMatches current = {0}, next = {0};
+	int start = 0;
+	if (word[0] == '/') {
+		addGlobMatch(&current, "/");
+		while (word[start] == '/') {
+			start++;
+		}
+	}
+	else {
+		addGlobMatch(&current, "");
+	}
+
+	// every part between slashes takes the matches so far one level deeper
+	while (start < length && current.count > 0)
+	{
+		int end = start;
+		while (end < length && word[end] != '/') {
+			end++;
+		}
+		int after = end;
+		while (after < length && word[after] == '/') {
+			after++;
+		}
+		bool last = after == length;
+		bool directoriesOnly = !last || end < length;
+
+		struct globComponent component;
+		bool pattern = compileGlobComponent(tok->arena, word, start, end, active, &component);
+		next.count = 0;
+		for (int i = 0; i < current.count; i++)
+		{
+			if (pattern) {
+				scanGlobDirectory(tok->arena, current.paths[i], &component, directoriesOnly, &next);
+				continue;
+			}
+
+			// a plain name only has to exist, a stat is needed for it only at the end of the pattern
+			size_t prefixLength = strlen(current.paths[i]);
+			char* path = arenaAlloc(tok->arena, prefixLength + strlen(component.name) + 2);
+			sprintf(path, "%s%s%s", current.paths[i], component.name, directoriesOnly ? "/" : "");
+			struct stat pathStat;
+			if (!last || fstatat(AT_FDCWD, path, &pathStat, AT_SYMLINK_NOFOLLOW) == 0) {
+				addGlobMatch(&next, path);
+			}
+		}
+		struct globMatches swap = current;
+		current = next;
+		next = swap;
+		start = after;
+	}
+	free(next.paths);
+
+	// matches are sorted like ls does, every one is an argument
+	int count = current.count;
+	qsort(current.paths, count, sizeof(char*), compareNames);
+	for (int i = 0; i < count; i++)
+	{
+		addWord(tok, current.paths[i]);
+		tok->current.argc++;
+		tok->argumentCount++;
+	}
+	free(current.paths);
+	return count;
+}
+
+// function to tokenize a command line in one pass into argv arrays and redirections. everything lives in the arena.
+// & never gets here, commandTextEnd splits the line at it and the node of the command keeps the background flag
+struct parsedCommand* parseCommandLine(struct arena* arena, const char* line)
+{
+	struct parsedCommand* parsed = arenaAlloc(arena, sizeof(struct parsedCommand));
+	struct tokenizer tok = {0};
+	tok.arena = arena;
+
+	// words cannot be longer than the line unless expansions grow them
+	tok.textCapacity = strlen(line) + 64;
+	tok.text = arenaAlloc(arena, tok.textCapacity);
+
+	// fd of a redirection operator that still needs its file, -1 if none. >> appends to the file
+	tok.pendingRedirection = -1;
+
+	const char* c = line;
+	while (tok.error == NULL)
+	{
+		// skip white space between words
+		while (*c == ' ' || *c == '\t' || *c == '\n') {
+			c++;
+		}
+		if (*c == '\0') {
+			break;
+		}
+
+		// operators cannot follow a redirection operator
+		if (strchr("|<>", *c) != NULL && tok.pendingRedirection != -1) {
+			tok.error = "Missing file for redirection in command line!";
+		}
+		// pipe operator starts a new stage, the stage before it cannot be empty
+		else if (*c == '|') {
+			if (tok.current.argc == 0) {
+				tok.error = "Missing command in command line!";
+			}
+			endStage(&tok);
+			c++;
+		}
+		// redirection operator, the next word is its file
+		else if (*c == '<' || *c == '>') {
+			tok.pendingRedirection = (*c == '<') ? 0 : 1;
+			tok.pendingAppend = (c[0] == '>' && c[1] == '>');
+			c += tok.pendingAppend ? 2 : 1;
+		}
+		// a word is either the file of a redirection or an argument. an unquoted $(command) with no output is no word at all
+		else {
+			c = readWord(&tok, c);
+			if (tok.error == NULL && tok.wordSplit && !tok.wordLiteral && tok.text[tok.wordStart] == '\0') {
+				if (tok.pendingRedirection != -1) {
+					tok.error = "Ambiguous redirection in command line!";
+				}
+				continue;
+			}
+			// a pattern that matches files becomes their names, one that matches nothing stays as it is
+			if (tok.error == NULL && tok.globCount > 0 && tok.pendingRedirection == -1 && expandGlob(&tok) > 0) {
+				continue;
+			}
+			takeWord(&tok, tok.text + tok.wordStart);
+		}
+	}
+
+	// redirection operator at the very end
+	if (tok.error == NULL && tok.pendingRedirection != -1) {
+		tok.error = "Missing file for redirection in command line!";
+	}
+
+	// last stage cannot be empty unless the whole line is
+	if (tok.error == NULL && tok.current.argc == 0 && (tok.stageCount > 0 || tok.current.redirectionCount > 0)) {
+		tok.error = "Missing command in command line!";
+	}
+	if (tok.current.argc > 0) {
+		endStage(&tok);
+	}
+
+	// every array is final now, point the stages into them
+	parsed->stages = arenaAlloc(arena, (tok.stageCount ? tok.stageCount : 1) * sizeof(struct pipelineStage));
+	for (int i = 0; i < tok.stageCount; i++)
+	{
+		parsed->stages[i].argv = &tok.words[tok.stages[i].firstWord];
+		parsed->stages[i].argc = tok.stages[i].argc;
+		parsed->stages[i].redirections = &tok.redirections[tok.stages[i].firstRedirection];
+		parsed->stages[i].redirectionCount = tok.stages[i].redirectionCount;
+	}
+	parsed->stageCount = tok.stageCount;
+	parsed->argumentCount = tok.argumentCount;
+	parsed->background = false;
+	parsed->cpus = NULL;
+	parsed->error = tok.error;
+	return parsed;
+}
+
+// function to make a node of a command line, text is copied from start up to end without the white space around it
+struct commandNode* newCommandNode(struct arena* arena, enum nodeType type, const char* start, const char* end)
+{
+	while (start < end && (*start == ' ' || *start == '\t' || *start == '\n')) {
+		start++;
+	}
+	while (end > start && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\n')) {
+		end--;
+	}
+	struct commandNode* node = arenaAlloc(arena, sizeof(struct commandNode));
+	node->type = type;
+	node->text = arenaAlloc(arena, end - start + 1);
+	memcpy(node->text, start, end - start);
+	node->text[end - start] = '\0';
+	node->background = false;
+	node->name = NULL;
+	node->words = NULL;
+	node->left = NULL;
+	node->right = NULL;
+	return node;
+}
+
+// function to join two nodes with ; && or ||, the text is what both cover
+struct commandNode* joinCommandNodes(struct arena* arena, enum nodeType type, struct commandNode* left, struct commandNode* right, const char* start, const char* end)
+{
+	struct commandNode* node = newCommandNode(arena, type, start, end);
+	node->left = left;
+	node->right = right;
+	return node;
+}
+
+// function to find where the command at c ends: at ; & && || a new line or the end of the text. quotes, backslashes and $( ) are skipped
+// so operators in them stay in the command, one that is not closed on its line runs to the end of the line and the tokenizer tells the user
+const char* commandTextEnd(const char* c)
+{
+	while (*c && *c != ';' && *c != '&' && *c != '\n' && !(c[0] == '|' && c[1] == '|'))
+	{
+		const char* end = NULL;
+		if (*c == '\'') {
+			end = strchr(c + 1, '\'');
+		}
+		else if (*c == '"') {
+			for (end = c + 1; *end && *end != '"'; end++) {
+				if (*end == '\\' && end[1] != '\0') {
+					end++;
+				}
+			}
+		}
+		else if (*c == '$' && c[1] == '(') {
+			end = substitutionEnd(c + 1);
+		}
+		else if (*c == '\\' && c[1] != '\0' && c[1] != '\n') {
+			end = c + 1;
+		}
+		else {
+			end = c;
+		}
+
+		const char* lineEnd = c + strcspn(c, "\n");
+		c = (end != NULL && *end != '\0' && end < lineEnd) ? end + 1 : lineEnd;
+	}
+	return c;
+}
+
+// function to see if a keyword starts at c: for, in, do, done, while, until, { or }, as a word of its own
+bool atKeyword(const char* c, const char* keyword)
+{
+	size_t length = strlen(keyword);
+	return strncmp(c, keyword, length) == 0 && (c[length] == '\0' || strchr(" \t\n;&|", c[length]) != NULL);
+}
+
+// function to get past spaces and tabs, newLines also gets past new lines and comments, where a command may start on the next line
+void skipBlanks(struct listParser* parser, bool newLines)
+{
+	while (true)
+	{
+		if (*parser->c == ' ' || *parser->c == '\t' || (newLines && *parser->c == '\n')) {
+			parser->c++;
+		}
+		else if (newLines && *parser->c == '#') {
+			parser->c += strcspn(parser->c, "\n");
+		}
+		else {
+			return;
+		}
+	}
+}
+
+// function to get past the keyword that has to come next, new lines may come before it. false with the error set if it is not there
+bool expectKeyword(struct listParser* parser, const char* keyword, char* error)
+{
+	skipBlanks(parser, true);
+	if (atKeyword(parser->c, keyword)) {
+		parser->c += strlen(keyword);
+		return true;
+	}
+	parser->error = error;
+	parser->incomplete = (*parser->c == '\0');
+	return false;
+}
+
+// function to read a name at c: a letter or _ followed by letters, digits and _. 0 if there is none
+size_t nameLength(const char* c)
+{
+	size_t length = 0;
+	if (isalpha((unsigned char)c[0]) || c[0] == '_') {
+		while (isalnum((unsigned char)c[length]) || c[length] == '_') {
+			length++;
+		}
+	}
+	return length;
+}
+
+// function to make a node of a for, while or function once its end is read, only ; & && || or the end of the line may come after it
+struct commandNode* endCompound(struct listParser* parser, enum nodeType type, const char* start, struct commandNode* left, struct commandNode* right)
+{
+	if (right == NULL) {
+		parser->error = "Missing command in command line!";
+		return NULL;
+	}
+	struct commandNode* node = newCommandNode(parser->arena, type, start, parser->c);
+	node->left = left;
+	node->right = right;
+	skipBlanks(parser, false);
+	if (*parser->c != '\0' && strchr(";&\n", *parser->c) == NULL && !(parser->c[0] == '|' && parser->c[1] == '|')) {
+		parser->error = "Missing ; after done or } in command line!";
+		return NULL;
+	}
+	return node;
+}
+
+struct commandNode* parseList(struct listParser* parser, bool nested);
+
+// function to read for NAME [in WORDS] (; or new line) do LIST done. the words are kept as written and expanded when the loop runs, no words is $@
+struct commandNode* parseFor(struct listParser* parser)
+{
+	const char* start = parser->c;
+	parser->c += 3;
+	skipBlanks(parser, false);
+	size_t length = nameLength(parser->c);
+	if (length == 0) {
+		parser->error = "Bad variable name in for loop in command line!";
+		return NULL;
+	}
+	char* name = arenaAlloc(parser->arena, length + 1);
+	memcpy(name, parser->c, length);
+	name[length] = '\0';
+	parser->c += length;
+	skipBlanks(parser, false);
+
+	// the words end like a command does, at ; or the end of the line
+	char* words = "$@";
+	if (atKeyword(parser->c, "in")) {
+		const char* wordStart = parser->c + 2;
+		parser->c = commandTextEnd(wordStart);
+		words = arenaAlloc(parser->arena, parser->c - wordStart + 1);
+		memcpy(words, wordStart, parser->c - wordStart);
+		words[parser->c - wordStart] = '\0';
+	}
+	if (*parser->c == ';') {
+		parser->c++;
+	}
+	else if (*parser->c != '\n' && *parser->c != '\0') {
+		parser->error = "Bad word list in for loop in command line!";
+		return NULL;
+	}
+
+	if (!expectKeyword(parser, "do", "Missing do in for loop in command line!")) {
+		return NULL;
+	}
+	struct commandNode* body = parseList(parser, true);
+	if (parser->error != NULL || !expectKeyword(parser, "done", "Missing done in command line!")) {
+		return NULL;
+	}
+	struct commandNode* node = endCompound(parser, NODE_FOR, start, NULL, body);
+	if (node != NULL) {
+		node->name = name;
+		node->words = words;
+	}
+	return node;
+}
+
+// function to read while LIST do LIST done, or until
+struct commandNode* parseWhile(struct listParser* parser)
+{
+	const char* start = parser->c;
+	enum nodeType type = atKeyword(parser->c, "while") ? NODE_WHILE : NODE_UNTIL;
+	parser->c += 5;
+	struct commandNode* condition = parseList(parser, true);
+	if (parser->error != NULL || !expectKeyword(parser, "do", "Missing do in while loop in command line!")) {
+		return NULL;
+	}
+	if (condition == NULL) {
+		parser->error = "Missing command in command line!";
+		return NULL;
+	}
+	struct commandNode* body = parseList(parser, true);
+	if (parser->error != NULL || !expectKeyword(parser, "done", "Missing done in command line!")) {
+		return NULL;
+	}
+	return endCompound(parser, type, start, condition, body);
+}
+
+// function to read NAME () { LIST }, a function the body of which runs when NAME is run as a command
+struct commandNode* parseFunction(struct listParser* parser, size_t length)
+{
+	const char* start = parser->c;
+	char* name = arenaAlloc(parser->arena, length + 1);
+	memcpy(name, parser->c, length);
+	name[length] = '\0';
+	parser->c = strchr(parser->c, ')') + 1;
+	if (!expectKeyword(parser, "{", "Missing { after function name in command line!")) {
+		return NULL;
+	}
+	struct commandNode* body = parseList(parser, true);
+	if (parser->error != NULL || !expectKeyword(parser, "}", "Missing } in command line!")) {
+		return NULL;
+	}
+	struct commandNode* node = endCompound(parser, NODE_FUNCTION, start, NULL, body);
+	if (node != NULL) {
+		node->name = name;
+	}
+	return node;
+}
+
+// function to read one command: a for, while or until loop, a function or a command that is tokenized when it runs
+struct commandNode* parseCommand(struct listParser* parser)
+{
+	skipBlanks(parser, false);
+	const char* c = parser->c;
+	if (atKeyword(c, "for")) {
+		return parseFor(parser);
+	}
+	if (atKeyword(c, "while") || atKeyword(c, "until")) {
+		return parseWhile(parser);
+	}
+	if (atKeyword(c, "do") || atKeyword(c, "done") || atKeyword(c, "in") || atKeyword(c, "{") || atKeyword(c, "}")) {
+		parser->error = "Misplaced keyword in command line!";
+		return NULL;
+	}
+
+	// a name followed by ( ) defines a function
+	size_t length = nameLength(c);
+	const char* after = c + length;
+	after += strspn(after, " \t");
+	if (length > 0 && after[0] == '(') {
+		after++;
+		after += strspn(after, " \t");
+		if (after[0] == ')') {
+			return parseFunction(parser, length);
+		}
+	}
+
+	parser->c = commandTextEnd(c);
+	if (parser->c == c) {
+		parser->error = "Missing command in command line!";
+		return NULL;
+	}
+	return newCommandNode(parser->arena, NODE_COMMAND, c, parser->c);
+}
+
+// function to read commands joined by && and ||, left to right. a new line may come after && and ||
+struct commandNode* parseAndOr(struct listParser* parser)
+{
+	const char* start = parser->c;
+	struct commandNode* list = parseCommand(parser);
+	while (list != NULL)
+	{
+		skipBlanks(parser, false);
+		bool and = parser->c[0] == '&' && parser->c[1] == '&';
+		if (!and && !(parser->c[0] == '|' && parser->c[1] == '|')) {
+			break;
+		}
+		parser->c += 2;
+		skipBlanks(parser, true);
+		if (*parser->c == '\0') {
+			parser->error = "Missing command in command line!";
+			parser->incomplete = true;
+			return NULL;
+		}
+		struct commandNode* command = parseCommand(parser);
+		if (command == NULL) {
+			return NULL;
+		}
+		list = joinCommandNodes(parser->arena, and ? NODE_AND : NODE_OR, list, command, start, parser->c);
+	}
+	return list;
+}
+
+// function to read a list of && || lists split by ; and &, & runs the list before it in the background. a list on the command line
+// ends at the end of its line, the body of a loop or function goes on over new lines up to its do, done or }. NULL if there is no command
+struct commandNode* parseList(struct listParser* parser, bool nested)
+{
+	struct commandNode* sequence = NULL;
+	while (true)
+	{
+		skipBlanks(parser, nested);
+		if (!nested && *parser->c == '#') {
+			parser->c += strcspn(parser->c, "\n");
+		}
+		if (*parser->c == '\0' || (!nested && *parser->c == '\n') || (nested && (atKeyword(parser->c, "do") || atKeyword(parser->c, "done") || atKeyword(parser->c, "}")))) {
+			return sequence;
+		}
+
+		struct commandNode* list = parseAndOr(parser);
+		if (list == NULL) {
+			return NULL;
+		}
+		skipBlanks(parser, false);
+		if (*parser->c == ';' || *parser->c == '&') {
+			list->background = (*parser->c == '&');
+			parser->c++;
+		}
+
+		// the sequence needs no text of its own, only lists run in the background do
+		sequence = (sequence == NULL) ? list : joinCommandNodes(parser->arena, NODE_SEQUENCE, sequence, list, parser->c, parser->c);
+	}
+}
+
+// function to split command lines into a tree: every line is a sequence of lists, a list is commands joined by && and ||, a command
+// is a simple command, a loop or a function. NULL for text with no command, error is set if it cannot run. when the text ends before a
+// loop or function does and incomplete is given, it is set instead of the error so the caller can read more lines
+struct commandNode* parseCommandList(struct arena* arena, const char* line, char** error, bool* incomplete)
+{
+	struct listParser parser = { arena, line, NULL, false };
+	struct commandNode* sequence = NULL;
+	while (true)
+	{
+		struct commandNode* list = parseList(&parser, false);
+		if (parser.error != NULL) {
+			break;
+		}
+		if (list != NULL) {
+			sequence = (sequence == NULL) ? list : joinCommandNodes(arena, NODE_SEQUENCE, sequence, list, parser.c, parser.c);
+		}
+		if (*parser.c == '\0') {
+			break;
+		}
+		parser.c++;
+	}
+
+	*error = parser.error;
+	if (incomplete != NULL) {
+		*incomplete = parser.incomplete;
+		if (parser.incomplete) {
+			*error = NULL;
+		}
+	}
+	return parser.error != NULL ? NULL : sequence;
+}
+
+// function to copy a tree into another arena, strings and all
+struct commandNode* copyCommandNode(struct arena* arena, struct commandNode* node)
+{
+	if (node == NULL) {
+		return NULL;
+	}
+	struct commandNode* copy = arenaAlloc(arena, sizeof(struct commandNode));
+	*copy = *node;
+	copy->text = arenaStrdup(arena, node->text);
+	copy->name = node->name != NULL ? arenaStrdup(arena, node->name) : NULL;
+	copy->words = node->words != NULL ? arenaStrdup(arena, node->words) : NULL;
+	copy->left = copyCommandNode(arena, node->left);
+	copy->right = copyCommandNode(arena, node->right);
+	return copy;
+}
+
+// function to find the redirection of fd in a stage, the last one wins. NULL if there is none
+struct redirection* findRedirection(struct pipelineStage* stage, int fd)
+{
+	struct redirection* found = NULL;
+	for (int i = 0; i < stage->redirectionCount; i++)
+	{
+		if (stage->redirections[i].fd == fd && stage->redirections[i].path != NULL) {
+			found = &stage->redirections[i];
+		}
+	}
+	return found;
+}
+
+// function to find the file a stage redirects fd to, the last redirection wins. NULL if there is none
+char* redirectionPath(struct pipelineStage* stage, int fd)
+{
+	struct redirection* found = findRedirection(stage, fd);
+	return found != NULL ? found->path : NULL;
+}
+
+// function to count the files a stage redirects fd to, more than one output file means a fan-out
+int countRedirections(struct pipelineStage* stage, int fd)
+{
+	int count = 0;
+	for (int i = 0; i < stage->redirectionCount; i++)
+	{
+		if (stage->redirections[i].fd == fd && stage->redirections[i].path != NULL) {
+			count++;
+		}
+	}
+	return count;
+}
+
+// function to open the file of an output redirection, >> appends and > truncates. prints a message and returns -1 if it cannot be opened
+int openOutputFile(struct redirection* output)
+{
+	int targetFD = open(output->path, O_WRONLY | O_CREAT | O_CLOEXEC | (output->append ? O_APPEND : O_TRUNC), 0640);
+	if (targetFD == -1) {
+		printf("cannot open %s for output\n", output->path);
+		fflush(stdout);
+	}
+	return targetFD;
+}
+
+// function to drop every redirection of fd from a stage, used once the shell took care of the file itself
+void dropRedirection(struct pipelineStage* stage, int fd)
+{
+	for (int i = 0; i < stage->redirectionCount; i++)
+	{
+		if (stage->redirections[i].fd == fd) {
+			stage->redirections[i].path = NULL;
+		}
+	}
+}
+
+// function to time the tokenizer on a typical command line and on a 2 KB one
+int benchParse(int iterations)
+{
+	// typical interactive line
+	char typical[] = "ls -la /usr/bin \"$HOME/some dir\" | grep -v '\\.so' > /tmp/out.$$.txt";
+
+	// long line of file names with some quoting, just under 2 KB
+	char longLine[2048];
+	int len = 0;
+	len += sprintf(longLine, "tar czf backup.tar.gz");
+	for (int i = 0; len < (int)sizeof(longLine) - 40; i++)
+	{
+		len += sprintf(longLine + len, (i % 8 == 0) ? " 'dir %d/file.log'" : " dir%d/file_%d.log", i, i);
+	}
+	len += sprintf(longLine + len, " > /tmp/list.$$");
+
+	char* lines[2] = { typical, longLine };
+	char* names[2] = { "typical", "2 KB" };
+	struct arena arena = {0};
+
+	for (int l = 0; l < 2; l++)
+	{
+		struct timespec start, end;
+		int words = 0;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (int i = 0; i < iterations; i++)
+		{
+			// reset per line, like the prompt loop does
+			arenaReset(&arena);
+			words += parseCommandLine(&arena, lines[l])->argumentCount;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		double elapsed = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+		printf("%s: %zu bytes, %d words, %.1f ns/line\n", names[l], strlen(lines[l]), words / iterations, elapsed / iterations);
+	}
+	fflush(stdout);
+	return 0;
+}
+
+// function to make room in the job table, doubles the number of entries and rebuilds the pid buckets
+void growJobTable(void)
+{
+	int oldCapacity = JOB_TABLE.capacity;
+	int capacity = oldCapacity ? oldCapacity * 2 : 64;
+
+	// from heap generate enough data for the entries and one bucket per entry
+	JOB_TABLE.jobs = realloc(JOB_TABLE.jobs, capacity * sizeof(struct job));
+	free(JOB_TABLE.buckets);
+	JOB_TABLE.buckets = malloc(capacity * sizeof(int));
+	JOB_TABLE.capacity = capacity;
+	for (int i = 0; i < capacity; i++)
+	{
+		JOB_TABLE.buckets[i] = -1;
+	}
+
+	// put running jobs back in their buckets, capacity is a power of two so the pid is masked
+	for (int i = 0; i < oldCapacity; i++)
+	{
+		if (JOB_TABLE.jobs[i].pid != 0) {
+			int bucket = JOB_TABLE.jobs[i].pid & (capacity - 1);
+			JOB_TABLE.jobs[i].next = JOB_TABLE.buckets[bucket];
+			JOB_TABLE.buckets[bucket] = i;
+		}
+	}
+
+	// new entries go on the free list
+	for (int i = capacity - 1; i >= oldCapacity; i--)
+	{
+		JOB_TABLE.jobs[i].pid = 0;
+		JOB_TABLE.jobs[i].next = JOB_TABLE.freeList;
+		JOB_TABLE.freeList = i;
+	}
+}
+
+// function to add a background process to the job table, entries of finished jobs are used first
+struct job* addJob(pid_t pid, bool silent)
+{
+	// no free entry left
+	if (JOB_TABLE.capacity == 0 || JOB_TABLE.freeList == -1) {
+		growJobTable();
+	}
+
+	// take an entry off the free list and put it in the bucket of its pid
+	int index = JOB_TABLE.freeList;
+	struct job* job = &JOB_TABLE.jobs[index];
+	int bucket = pid & (JOB_TABLE.capacity - 1);
+	JOB_TABLE.freeList = job->next;
+	job->pid = pid;
+	job->silent = silent;
+	job->number = 0;
+	job->group = 0;
+	job->stopped = false;
+	job->command = NULL;
+	job->cpus = NULL;
+	job->node = -1;
+	job->next = JOB_TABLE.buckets[bucket];
+	JOB_TABLE.buckets[bucket] = index;
+	JOB_TABLE.count++;
+	return job;
+}
+
+// function to number a new job, one more than the highest number in use
+int nextJobNumber(void)
+{
+	int highest = 0;
+	for (int i = 0; i < JOB_TABLE.capacity; i++)
+	{
+		if (JOB_TABLE.jobs[i].pid != 0 && JOB_TABLE.jobs[i].number > highest) {
+			highest = JOB_TABLE.jobs[i].number;
+		}
+	}
+	return highest + 1;
+}
+
+// function to find a background process in the job table, NULL if it is not there
+struct job* findJob(pid_t pid)
+{
+	if (JOB_TABLE.capacity == 0) {
+		return NULL;
+	}
+
+	// walk the bucket of the pid
+	for (int index = JOB_TABLE.buckets[pid & (JOB_TABLE.capacity - 1)]; index != -1; index = JOB_TABLE.jobs[index].next)
+	{
+		if (JOB_TABLE.jobs[index].pid == pid) {
+			return &JOB_TABLE.jobs[index];
+		}
+	}
+	return NULL;
+}
+
+// function to take a finished process out of the job table, its entry goes back on the free list
+void removeJob(pid_t pid)
+{
+	// pointer to the link that points at the current entry
+	int* link = &JOB_TABLE.buckets[pid & (JOB_TABLE.capacity - 1)];
+	while (*link != -1)
+	{
+		struct job* job = &JOB_TABLE.jobs[*link];
+		if (job->pid == pid) {
+			int index = *link;
+			*link = job->next;
+			job->pid = 0;
+			free(job->cpus);
+			free(job->command);
+			job->cpus = NULL;
+			job->command = NULL;
+			job->next = JOB_TABLE.freeList;
+			JOB_TABLE.freeList = index;
+			JOB_TABLE.count--;
+			return;
+		}
+		link = &job->next;
+	}
+}
+
+// function to set up SIGCHLD delivery through a signalfd, the shell reads child exits like any other input
+void watchChildren(void)
+{
+	// a blocked SIGCHLD stays pending for the signalfd instead of interrupting the shell
+	sigset_t childSignal;
+	sigemptyset(&childSignal);
+	sigaddset(&childSignal, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &childSignal, NULL);
+	SIGCHLD_FD = signalfd(-1, &childSignal, SFD_NONBLOCK | SFD_CLOEXEC);
+}
+
+// The signal handler for SIGSTP - only for main process
+void handle_SIGTSTP(int signo) {
+	if (!FOREGROUND_ONLY) {
+		char* message = "\nEntering foreground-only mode (& is now ignored)\n";
+		FOREGROUND_ONLY = true;
+		// reentrant function
+		write(STDOUT_FILENO, message, 50);
+		fflush(stdout);
+	}
+	else {
+		char* message = "\nExiting foreground-only mode\n";
+		FOREGROUND_ONLY = false;
+		// reentrant function
+		write(STDOUT_FILENO, message, 30);
+		fflush(stdout);
+	}
+}
+
+// The signal handler for SIGINT - only for child foreground process
+void handle_SIGINT(int signo) {
+	char* message = "terminated by signal ";
+	// reentrant function
+	write(STDOUT_FILENO, message, 21);
+	fflush(stdout);
+}
+
+// function to add the resource usage of one process to a total, max rss is the largest of them
+void addUsage(struct rusage* total, struct rusage* usage)
+{
+	timeradd(&total->ru_utime, &usage->ru_utime, &total->ru_utime);
+	timeradd(&total->ru_stime, &usage->ru_stime, &total->ru_stime);
+	if (usage->ru_maxrss > total->ru_maxrss) {
+		total->ru_maxrss = usage->ru_maxrss;
+	}
+	total->ru_majflt += usage->ru_majflt;
+	total->ru_minflt += usage->ru_minflt;
+	total->ru_nvcsw += usage->ru_nvcsw;
+	total->ru_nivcsw += usage->ru_nivcsw;
+}
+
+// function to print wall clock, cpu time, peak memory, faults and context switches of a job
+void printUsage(FILE* stream, struct jobUsage* usage)
+{
+	// a builtin runs in the shell and has no processes of its own
+	if (usage->stageCount == 0) {
+		fprintf(stream, "command: %s (builtin)\n", usage->command);
+	}
+	else {
+		fprintf(stream, "command: %s (%d %s)\n", usage->command, usage->stageCount, usage->stageCount == 1 ? "process" : "processes");
+	}
+	fprintf(stream, "real %ld.%06ld s\n", (long)usage->wall.tv_sec, usage->wall.tv_nsec / 1000);
+	fprintf(stream, "user %ld.%06ld s\n", (long)usage->usage.ru_utime.tv_sec, (long)usage->usage.ru_utime.tv_usec);
+	fprintf(stream, "sys %ld.%06ld s\n", (long)usage->usage.ru_stime.tv_sec, (long)usage->usage.ru_stime.tv_usec);
+	fprintf(stream, "max rss %ld kB\n", usage->usage.ru_maxrss);
+	fprintf(stream, "faults %ld major, %ld minor\n", usage->usage.ru_majflt, usage->usage.ru_minflt);
+	fprintf(stream, "context switches %ld voluntary, %ld involuntary\n", usage->usage.ru_nvcsw, usage->usage.ru_nivcsw);
+	fflush(stream);
+}
+
+// function to take the wall clock between start and now
+struct timespec elapsedSince(struct timespec* start)
+{
+	struct timespec now, elapsed;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed.tv_sec = now.tv_sec - start->tv_sec;
+	elapsed.tv_nsec = now.tv_nsec - start->tv_nsec;
+	if (elapsed.tv_nsec < 0) {
+		elapsed.tv_sec--;
+		elapsed.tv_nsec += 1000000000;
+	}
+	return elapsed;
+}
+
+// function to see if a shell status is the one of a command killed by a signal, then SIGNAL_NUMBER is that signal.
+// an exit value is never taken for one, SIGNAL_NUMBER is 0 once a process exited
+bool killedBySignal(int status)
+{
+	return SIGNAL_NUMBER != 0 && status == 128 + SIGNAL_NUMBER;
+}
+
+// function for status command, -v adds what the last foreground job used. the status stays what it was
+int showStatus(char* argv[], struct shellState* shell)
+{
+	// if the last foreground process was killed, print the terminating signal
+	if (killedBySignal(shell->status)) {
+		printf("terminated by signal %d\n", SIGNAL_NUMBER);
+	}
+	// else, print status
+	else {
+		printf("exit value %d\n", shell->status);
+	}
+	fflush(stdout);
+
+	if (argv[1] != NULL && strcmp(argv[1], "-v") == 0 && LAST_USAGE.count > 0) {
+		printUsage(stdout, &LAST_USAGE);
+	}
+	return shell->status;
+}
+
+// function for memstats command, prints arena counters and the resident set size of the shell
+int showMemoryStats(char* argv[], struct shellState* shell)
+{
+	struct arena* arena = shell->arena;
+
+	// resident pages from /proc, peak from getrusage
+	long residentPages = 0;
+	FILE* statm = fopen("/proc/self/statm", "r");
+	if (statm != NULL) {
+		fscanf(statm, "%*s %ld", &residentPages);
+		fclose(statm);
+	}
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	// count blocks in the arena
+	int blocks = 0;
+	for (struct arenaBlock* block = arena->first; block != NULL; block = block->next)
+	{
+		blocks++;
+	}
+
+	printf("arena: %zu bytes reserved in %d blocks, %zu in use, high water %zu\n", arena->reserved, blocks, arena->inUse, arena->highWater);
+	printf("arena: %zu allocations, %zu bytes since start, %ld resets\n", arena->allocations, arena->totalBytes, arena->resets);
+	printf("rss: %ld kB, peak %ld kB\n", residentPages * (sysconf(_SC_PAGESIZE) / 1024), usage.ru_maxrss);
+	fflush(stdout);
+	return 0;
+}
+
+// function for CD command
+int changeDirectory(char* argv[], struct shellState* shell)
+{
+	// boolean value for argument, env variable for HOME
+	bool argument = false;
+	char* home = getenv("HOME");
+
+	// check if there is an argument in user command
+	if (argv[1] != NULL) {
+		argument = true;
+	}
+
+	// cd command has argument
+	if (argument) {
+		// check if user provided path is absolute (starts with /)
+		if (argv[1][0] == '/') {
+			
+			// change directory to absolute path
+			int ret = chdir(argv[1]);
+
+			// unsuccesful cd, send message and 1 status
+			if (ret != 0) {
+				printf("No such file or directory\n");
+				fflush(stdout);
+				return 1;
+			}
+
+			// return 0 if succesful
+			return 0;
+		}
+
+		// else, create a relative path. concat /argument to end of current directory
+		char* currentDir = getcwd(NULL, 0);
+		int totalPathLength = strlen(currentDir) + strlen(argv[1]) + 2;
+		char relativePath [totalPathLength];
+
+		relativePath[0] = '\0';
+
+		strcat(relativePath, currentDir);
+		free(currentDir);
+		strcat(relativePath, "/");
+		strcat(relativePath, argv[1]);
+
+		// change directory to relative path
+		int ret = chdir(relativePath);
+
+		// unsuccesful cd, send message and 1 status
+		if (ret != 0) {
+			printf("No such file or directory\n");
+			fflush(stdout);
+			return 1;
+		}
+
+		// return 0 if succesful
+		return 0;
+	}
+	else {
+		chdir(home);  // go to home ENV variable
+		return 0;
+	}
+}
+
+// function to hash a string into a bucket of a table with tableSize buckets
+unsigned int hashString(const char* s, unsigned int tableSize)
+{
+	// FNV-1a over the bytes of the string
+	unsigned int hash = 2166136261u;
+	while (*s) {
+		hash = (hash ^ (unsigned char)*s++) * 16777619u;
+	}
+	return hash % tableSize;
+}
+
+// function to find the function called name, NULL if there is none
+struct shellFunction* findFunction(const char* name)
+{
+	for (struct shellFunction* function = FUNCTIONS[hashString(name, FUNCTION_TABLE_SIZE)]; function != NULL; function = function->next)
+	{
+		if (strcmp(function->name, name) == 0) {
+			return function;
+		}
+	}
+	return NULL;
+}
+
+// function to find the histogram bucket of a latency in microseconds: exact below 16, then 16 buckets per power of two
+int latencyBucket(unsigned long micros)
+{
+	if (micros < 16) {
+		return micros;
+	}
+	int exponent = 63 - __builtin_clzl(micros);
+	return (exponent - 3) * 16 + ((micros >> (exponent - 4)) & 15);
+}
+
+// function to get the microseconds a bucket stands for, the middle of its range
+double bucketLatency(int bucket)
+{
+	if (bucket < 16) {
+		return bucket;
+	}
+	int exponent = bucket / 16 + 3;
+	double width = (double)(1UL << (exponent - 4));
+	return (16 + bucket % 16) * width + width / 2;
+}
+
+// function to find the stats of a command name, add creates them if there are none. NULL if there are none
+struct commandStats* findCommandStats(const char* name, bool add)
+{
+	unsigned int bucket = hashString(name, STATS_TABLE_SIZE);
+	for (struct commandStats* stats = COMMAND_STATS[bucket]; stats != NULL; stats = stats->next)
+	{
+		if (strcmp(stats->name, name) == 0) {
+			return stats;
+		}
+	}
+	if (!add) {
+		return NULL;
+	}
+	struct commandStats* stats = calloc(1, sizeof(struct commandStats));
+	stats->name = strdup(name);
+	stats->next = COMMAND_STATS[bucket];
+	COMMAND_STATS[bucket] = stats;
+	return stats;
+}
+
+// function to write one field of a CSV record, quoted if it has a comma, a quote or a new line. a field longer than size is cut short,
+// returns the bytes written without the NUL
+size_t csvField(char* buffer, size_t size, const char* field)
+{
+	if (size < 4) {
+		buffer[0] = '\0';
+		return 0;
+	}
+	if (strpbrk(field, ",\"\n") == NULL) {
+		size_t length = snprintf(buffer, size, "%s", field);
+		return length < size ? length : size - 1;
+	}
+	size_t used = 0;
+	buffer[used++] = '"';
+	for (const char* c = field; *c && used + 3 < size; c++)
+	{
+		if (*c == '"') {
+			buffer[used++] = '"';
+		}
+		buffer[used++] = *c;
+	}
+	buffer[used++] = '"';
+	buffer[used] = '\0';
+	return used;
+}
+
+// function to count a finished command in the stats and append its record to the metrics log if there is one.
+// status is the shell status, signalNumber the signal that killed it or 0
+void recordCommand(const char* name, bool background, struct timespec* wall, struct rusage* usage, int status, int signalNumber)
+{
+	unsigned long micros = wall->tv_sec * 1000000UL + wall->tv_nsec / 1000;
+	struct commandStats* stats = findCommandStats(name, true);
+	stats->count++;
+	stats->failures += status != 0;
+	stats->buckets[latencyBucket(micros)]++;
+	if (METRICS_FD == -1) {
+		return;
+	}
+
+	// the command started wall ago
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	long long startNanos = (now.tv_sec - wall->tv_sec) * 1000000000LL + (now.tv_nsec - wall->tv_nsec);
+
+	// start_ns,hash,command,mode,wall_us,user_us,sys_us,max_rss_kb,status,signal. one write per record so concurrent shells can share the log.
+	// a long name is cut short to leave room for the numbers, the hash is of all of it
+	char record[512];
+	size_t used = snprintf(record, sizeof(record), "%lld,%08x,", startNanos, hashString(name, 4294967295u));
+	used += csvField(record + used, sizeof(record) - used - 128, name);
+	size_t tail = snprintf(record + used, sizeof(record) - used, ",%s,%lu,%ld,%ld,%ld,%d,%d\n", background ? "bg" : "fg", micros,
+		usage->ru_utime.tv_sec * 1000000L + usage->ru_utime.tv_usec, usage->ru_stime.tv_sec * 1000000L + usage->ru_stime.tv_usec,
+		usage->ru_maxrss, status, signalNumber);
+	used += tail < sizeof(record) - used ? tail : sizeof(record) - used - 1;
+	write(METRICS_FD, record, used);
+}
+
+// function to record a builtin, which runs in the shell. the shell's own cpu time is taken only when before is given
+void recordBuiltin(const char* name, struct timespec* start, struct rusage* before, int status)
+{
+	struct timespec wall = elapsedSince(start);
+	struct rusage usage = {0};
+	if (before != NULL) {
+		getrusage(RUSAGE_SELF, &usage);
+		timersub(&usage.ru_utime, &before->ru_utime, &usage.ru_utime);
+		timersub(&usage.ru_stime, &before->ru_stime, &usage.ru_stime);
+	}
+	recordCommand(name, false, &wall, &usage, status, killedBySignal(status) ? SIGNAL_NUMBER : 0);
+}
+
+// function to start appending records to a metrics log, an empty file gets the CSV header first. returns -1 if it cannot be opened
+int openMetrics(const char* path)
+{
+	int metricsFD = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	struct stat metricsStat;
+	if (metricsFD == -1 || fstat(metricsFD, &metricsStat) == -1) {
+		if (metricsFD != -1) {
+			close(metricsFD);
+		}
+		return -1;
+	}
+	if (metricsStat.st_size == 0) {
+		char header[] = "start_ns,hash,command,mode,wall_us,user_us,sys_us,max_rss_kb,status,signal\n";
+		write(metricsFD, header, sizeof(header) - 1);
+	}
+
+	// the old log is closed once the new one is open
+	if (METRICS_FD != -1) {
+		close(METRICS_FD);
+	}
+	free(METRICS_PATH);
+	METRICS_FD = metricsFD;
+	METRICS_PATH = strdup(path);
+	return 0;
+}
+
+// function to stop the metrics log
+void closeMetrics(void)
+{
+	if (METRICS_FD != -1) {
+		close(METRICS_FD);
+	}
+	free(METRICS_PATH);
+	METRICS_FD = -1;
+	METRICS_PATH = NULL;
+}
+
+// function for set command, each argument is an option in the form name=value
+int setOption(char* argv[], struct shellState* shell)
+{
+	// no arguments, print every option and its value
+	if (argv[1] == NULL) {
+		printf("pipefail=%s\n", PIPEFAIL ? "on" : "off");
+		printf("relay=%s\n", SPLICE_RELAY ? "on" : "off");
+		printf("spawn=%s\n", SPAWN_MODE_NAMES[SPAWN_MODE]);
+		printf("placement=%s\n", PLACEMENT_NAMES[PLACEMENT]);
+		printf("metrics=%s\n", METRICS_PATH != NULL ? METRICS_PATH : "off");
+		if (CAPTURE_SIZE > 0) {
+			printf("capture=%zu\n", CAPTURE_SIZE);
+		}
+		else {
+			printf("capture=off\n");
+		}
+		fflush(stdout);
+		return 0;
+	}
+
+	// loop thru arguments and set every option
+	for (int i = 1; argv[i] != NULL; i++)
+	{
+		// split argument at =
+		char* value = strchr(argv[i], '=');
+		bool* option = NULL;
+		if (value != NULL) {
+			*value = '\0';
+			value++;
+
+			// find the option to update
+			if (strcmp(argv[i], "pipefail") == 0) {
+				option = &PIPEFAIL;
+			}
+			else if (strcmp(argv[i], "relay") == 0) {
+				option = &SPLICE_RELAY;
+			}
+			// spawn takes the name of a spawn mode instead of on or off
+			else if (strcmp(argv[i], "spawn") == 0) {
+				int mode = SPAWN_POSIX_SPAWN;
+				while (mode >= 0 && strcmp(value, SPAWN_MODE_NAMES[mode]) != 0) {
+					mode--;
+				}
+				if (mode >= 0) {
+					SPAWN_MODE = mode;
+					continue;
+				}
+			}
+			// metrics takes the file to append records to, or off
+			else if (strcmp(argv[i], "metrics") == 0) {
+				if (strcmp(value, "off") == 0) {
+					closeMetrics();
+					continue;
+				}
+				if (*value != '\0' && openMetrics(value) == 0) {
+					continue;
+				}
+				perror(value);
+				fflush(stdout);
+				return 1;
+			}
+			// capture takes how many bytes to keep of every background job, k and m count in KB and MB, or off
+			else if (strcmp(argv[i], "capture") == 0) {
+				char* unit;
+				unsigned long size = strtoul(value, &unit, 10);
+				size <<= (*unit == 'k' || *unit == 'K') ? 10 : (*unit == 'm' || *unit == 'M') ? 20 : 0;
+				unit += (*unit != '\0' && strchr("kKmM", *unit) != NULL);
+				if (strcmp(value, "off") == 0) {
+					CAPTURE_SIZE = 0;
+					continue;
+				}
+				if (isdigit((unsigned char)*value) && *unit == '\0' && size > 0) {
+					CAPTURE_SIZE = size;
+					continue;
+				}
+			}
+			// placement takes the name of a policy too
+			else if (strcmp(argv[i], "placement") == 0) {
+				int policy = PLACEMENT_NUMA;
+				while (policy >= 0 && strcmp(value, PLACEMENT_NAMES[policy]) != 0) {
+					policy--;
+				}
+				if (policy >= 0) {
+					PLACEMENT = policy;
+					continue;
+				}
+			}
+		}
+
+		// unknown option or value, send message and 1 status. the argument was split at =, the value is printed after the name
+		if (option == NULL || (strcmp(value, "on") != 0 && strcmp(value, "off") != 0)) {
+			printf("set: bad option %s%s%s\n", argv[i], value != NULL ? "=" : "", value != NULL ? value : "");
+			fflush(stdout);
+			return 1;
+		}
+		*option = strcmp(value, "on") == 0;
+	}
+	return 0;
+}
+
+// function to convert a status from waitpid into the shell status: the exit value, or 128 + the signal that killed it.
+// signalNumber is that signal, 0 for a process that exited
+int convertStatus(int childStatus, int* signalNumber)
+{
+	// abnormal termination due to signal, hand back the signal number
+	if (WIFSIGNALED(childStatus))
+	{
+		*signalNumber = WTERMSIG(childStatus);
+		return 128 + *signalNumber;
+	}
+
+	*signalNumber = 0;
+	return WEXITSTATUS(childStatus);
+}
+
+// function to write all of buffer, returns -1 if the write fails
+int writeAll(int fd, const char* buffer, size_t length)
+{
+	while (length > 0)
+	{
+		ssize_t written = write(fd, buffer, length);
+		if (written == -1 && errno != EINTR) {
+			return -1;
+		}
+		if (written > 0) {
+			buffer += written;
+			length -= written;
+		}
+	}
+	return 0;
+}
+
+// function to move up to count bytes from inFD to outFD with splice, returns the bytes moved and 0 at end of file.
+// splice cannot write to an O_APPEND file, copy is set then and the bytes go through buffer instead
+ssize_t relayBytes(int inFD, int outFD, size_t count, bool* copy, char* buffer, size_t bufferSize)
+{
+	if (!*copy) {
+		ssize_t moved = splice(inFD, NULL, outFD, NULL, count, SPLICE_F_MOVE | SPLICE_F_MORE);
+		if (moved != -1 || errno != EINVAL) {
+			return moved;
+		}
+		*copy = true;
+	}
+	ssize_t got = read(inFD, buffer, count < bufferSize ? count : bufferSize);
+	if (got > 0 && writeAll(outFD, buffer, got) == -1) {
+		return -1;
+	}
+	return got;
+}
+
+// function to move everything from inFD to outFD with splice, the data never passes through a userspace buffer unless outFD appends
+int spliceRelay(int inFD, int outFD)
+{
+	ssize_t moved;
+	char buffer[1 << 16];
+	bool copy = (fcntl(outFD, F_GETFL) & O_APPEND) != 0;
+
+	// splice 64k at a time until the writer closes its end, one side is always a pipe
+	do
+	{
+		moved = relayBytes(inFD, outFD, sizeof(buffer), &copy, buffer, sizeof(buffer));
+	} while (moved > 0 || (moved == -1 && errno == EINTR));
+
+	return moved == 0 ? 0 : -1;
+}
+
+// function to read and drop what is left in a pipe, what a file that failed would have gotten. the pipe is asked how much that is,
+// a copy that failed halfway may have read part of it already and a read for more would wait for a writer that never comes
+void discardPipe(int inFD, char* buffer, size_t bufferSize)
+{
+	int count;
+	if (ioctl(inFD, FIONREAD, &count) == -1) {
+		return;
+	}
+	while (count > 0)
+	{
+		ssize_t got = read(inFD, buffer, (size_t)count < bufferSize ? (size_t)count : bufferSize);
+		if (got == 0 || (got == -1 && errno != EINTR)) {
+			return;
+		}
+		if (got > 0) {
+			count -= got;
+		}
+	}
+}
+
+// function to copy everything written into the pipe inFD into every file of outFDs. each file but the last gets a tee(2)
+// copy of the pipe's pages through a spare pipe, the last one gets the pages themselves. a file that fails is dropped
+int teeRelay(int inFD, int outFDs[], int outCount)
+{
+	int status = 0;
+	int spare[2];
+	if (pipe2(spare, O_CLOEXEC) == -1) {
+		return -1;
+	}
+
+	// the spare pipe has to hold whatever the input pipe holds, one tee then copies a whole round
+	fcntl(spare[1], F_SETPIPE_SZ, fcntl(inFD, F_GETPIPE_SZ));
+	size_t chunkMax = fcntl(spare[1], F_GETPIPE_SZ);
+	char* buffer = malloc(chunkMax);
+
+	// bytes each file got this round, and the files that need the copy fallback
+	size_t got[outCount];
+	bool copy[outCount];
+	for (int i = 0; i < outCount; i++) {
+		copy[i] = (fcntl(outFDs[i], F_GETFL) & O_APPEND) != 0;
+	}
+
+	while (true)
+	{
+		// tee blocks until the stage writes something and returns 0 once every writer is gone
+		ssize_t chunk = tee(inFD, spare[1], chunkMax, 0);
+		if (chunk == -1 && errno == EINTR) {
+			continue;
+		}
+		if (chunk <= 0) {
+			status = (chunk == 0) ? status : -1;
+			break;
+		}
+
+		// every file but the last gets a copy through the spare pipe, the first copy is already there
+		bool shortCopy = false;
+		for (int i = 0; i < outCount - 1; i++)
+		{
+			got[i] = 0;
+			if (outFDs[i] == -1) {
+				// the round's first copy is in the spare pipe whatever happened to the first file, left there it fills the pipe and tee blocks
+				if (i == 0) {
+					discardPipe(spare[0], buffer, chunkMax);
+				}
+				continue;
+			}
+			ssize_t teed = chunk;
+			if (i > 0) {
+				while ((teed = tee(inFD, spare[1], chunk, 0)) == -1 && errno == EINTR);
+			}
+			if (teed <= 0) {
+				shortCopy = true;
+				continue;
+			}
+
+			// empty the spare pipe into the file, the rest is dropped if the file fails
+			while (got[i] < (size_t)teed)
+			{
+				ssize_t moved = relayBytes(spare[0], outFDs[i], teed - got[i], &copy[i], buffer, chunkMax);
+				if (moved == -1 && errno == EINTR) {
+					continue;
+				}
+				if (moved <= 0) {
+					discardPipe(spare[0], buffer, chunkMax);
+					close(outFDs[i]);
+					outFDs[i] = -1;
+					status = -1;
+					break;
+				}
+				got[i] += moved;
+			}
+			shortCopy = shortCopy || (outFDs[i] != -1 && got[i] < (size_t)chunk);
+		}
+
+		// the last file takes the bytes out of the input pipe
+		int last = outCount - 1;
+		size_t taken = 0;
+		while (!shortCopy && outFDs[last] != -1 && taken < (size_t)chunk)
+		{
+			ssize_t moved = relayBytes(inFD, outFDs[last], chunk - taken, &copy[last], buffer, chunkMax);
+			if (moved == -1 && errno == EINTR) {
+				continue;
+			}
+			if (moved <= 0) {
+				close(outFDs[last]);
+				outFDs[last] = -1;
+				status = -1;
+				break;
+			}
+			taken += moved;
+		}
+
+		// a tee that came up short or a failed last file, what is left of the round goes through the buffer
+		if (taken < (size_t)chunk)
+		{
+			size_t left = chunk - taken;
+			size_t length = 0;
+			while (length < left)
+			{
+				ssize_t count = read(inFD, buffer + length, left - length);
+				if (count == -1 && errno == EINTR) {
+					continue;
+				}
+				if (count <= 0) {
+					break;
+				}
+				length += count;
+			}
+			for (int i = 0; i < last; i++)
+			{
+				// taken is 0 when a copy came up short, the buffer starts at the beginning of the round
+				if (outFDs[i] != -1 && got[i] < (size_t)chunk && writeAll(outFDs[i], buffer + got[i], chunk - got[i]) == -1) {
+					status = -1;
+				}
+			}
+			if (outFDs[last] != -1 && writeAll(outFDs[last], buffer, length) == -1) {
+				status = -1;
+			}
+		}
+	}
+	free(buffer);
+	return status;
+}
+
+// function to kill and reap the processes of a pipeline that cannot be completed, every pid is -1 afterwards
+void killProcesses(pid_t pids[], int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		if (pids[i] != -1) {
+			kill(pids[i], SIGKILL);
+			while (waitpid(pids[i], NULL, 0) == -1 && errno == EINTR);
+			pids[i] = -1;
+		}
+	}
+}
+
+// function to fork a relay process that splices inFD into outFD, closeFDs are pipe ends the relay must not hold open. -1 if it cannot start
+pid_t startRelay(int inFD, int outFD, int closeFDs[2])
+{
+	pid_t relayProcess = fork();
+	switch (relayProcess)
+	{
+	case -1:
+		// fork fails send message, the caller fails the pipeline
+		perror("Command failed! Please try again!");
+		fflush(stdout);
+		return -1;
+	case 0:
+		// relay is not a job, ^C and ^Z are meant for the stages
+		signal(SIGINT, SIG_IGN);
+		signal(SIGTSTP, SIG_IGN);
+
+		// a relay that keeps the far end of a pipe open never sees EOF or EPIPE
+		for (int i = 0; i < 2; i++)
+		{
+			if (closeFDs[i] != -1) {
+				close(closeFDs[i]);
+			}
+		}
+		_exit(spliceRelay(inFD, outFD) == 0 ? 0 : 1);
+	default:
+		return relayProcess;
+	}
+}
+
+// function to close every fd from 3 up except the ones in keep, for a relay that does not exec and would hold pipe ends open
+void closeOtherFDs(int keep[], int keepCount)
+{
+	// sort the fds to keep, then close the gaps between them
+	for (int i = 1; i < keepCount; i++)
+	{
+		for (int j = i; j > 0 && keep[j - 1] > keep[j]; j--) {
+			int swap = keep[j];
+			keep[j] = keep[j - 1];
+			keep[j - 1] = swap;
+		}
+	}
+	unsigned int next = 3;
+	for (int i = 0; i < keepCount; i++)
+	{
+		if ((unsigned int)keep[i] > next) {
+			close_range(next, keep[i] - 1, 0);
+		}
+		if ((unsigned int)keep[i] >= next) {
+			next = keep[i] + 1;
+		}
+	}
+	close_range(next, ~0U, 0);
+}
+
+// function to fork a fan-out relay that copies the pipe inFD into every file of outFDs, -1 if it cannot start
+pid_t startFanout(int inFD, int outFDs[], int outCount)
+{
+	pid_t relayProcess = fork();
+	if (relayProcess == 0)
+	{
+		// relay is not a job, ^C and ^Z are meant for the stages
+		signal(SIGINT, SIG_IGN);
+		signal(SIGTSTP, SIG_IGN);
+
+		// keep only the pipe and the files, any other pipe end would keep a reader waiting for EOF
+		int keep[outCount + 1];
+		memcpy(keep, outFDs, outCount * sizeof(int));
+		keep[outCount] = inFD;
+		closeOtherFDs(keep, outCount + 1);
+		_exit(teeRelay(inFD, outFDs, outCount) == 0 ? 0 : 1);
+	}
+
+	// fork fails send message
+	if (relayProcess == -1) {
+		perror("Command failed! Please try again!");
+		fflush(stdout);
+	}
+	return relayProcess;
+}
+
+// function to open the files at both ends of a pipeline and put a splice relay between each file and the stages
+int openRelays(struct pipelineStage stages[], int stageCount, int* pipelineIn, int* pipelineOut, pid_t relayPids[])
+{
+	// ends of the relay pipes, read end of input relay and write end of output relay go to the stages
+	int inputPipe[2] = { -1, -1 };
+	int outputPipe[2] = { -1, -1 };
+
+	// files at either end of the pipeline, more than one output file is left to the fan-out relay
+	char* inputSource = redirectionPath(&stages[0], 0);
+	struct redirection* output = countRedirections(&stages[stageCount - 1], 1) == 1 ? findRedirection(&stages[stageCount - 1], 1) : NULL;
+	int sourceFD = -1;
+	int targetFD = -1;
+
+	// open both files in the shell so a bad path fails the pipeline before anything runs
+	if (inputSource != NULL)
+	{
+		sourceFD = open(inputSource, O_RDONLY | O_CLOEXEC);
+		if (sourceFD == -1) {
+			printf("cannot open %s for input\n", inputSource);
+			fflush(stdout);
+			return -1;
+		}
+	}
+	if (output != NULL)
+	{
+		targetFD = openOutputFile(output);
+		if (targetFD == -1) {
+			if (sourceFD != -1) close(sourceFD);
+			return -1;
+		}
+	}
+
+	// input relay splices the file into a pipe that the first stage reads
+	if (sourceFD != -1)
+	{
+		if (pipe2(inputPipe, O_CLOEXEC) == -1) {
+			perror("pipe");
+			fflush(stdout);
+			close(sourceFD);
+			if (targetFD != -1) close(targetFD);
+			return -1;
+		}
+		int closeFDs[2] = { inputPipe[0], -1 };
+		relayPids[0] = startRelay(sourceFD, inputPipe[1], closeFDs);
+		close(sourceFD);
+		close(inputPipe[1]);
+		if (relayPids[0] == -1) {
+			close(inputPipe[0]);
+			if (targetFD != -1) close(targetFD);
+			return -1;
+		}
+		*pipelineIn = inputPipe[0];
+		dropRedirection(&stages[0], 0);
+	}
+
+	// output relay splices what the last stage writes into the file
+	if (targetFD != -1)
+	{
+		if (pipe2(outputPipe, O_CLOEXEC) == -1) {
+			perror("pipe");
+			fflush(stdout);
+		}
+		else {
+			int closeFDs[2] = { outputPipe[1], inputPipe[0] };
+			relayPids[1] = startRelay(outputPipe[0], targetFD, closeFDs);
+			close(outputPipe[0]);
+			if (relayPids[1] == -1) {
+				close(outputPipe[1]);
+			}
+		}
+		close(targetFD);
+
+		// without the output relay the input relay has no one to feed, it goes too
+		if (relayPids[1] == -1) {
+			if (inputPipe[0] != -1) {
+				close(inputPipe[0]);
+				*pipelineIn = -1;
+			}
+			killProcesses(relayPids, 1);
+			return -1;
+		}
+		*pipelineOut = outputPipe[1];
+		dropRedirection(&stages[stageCount - 1], 1);
+	}
+	return 0;
+}
+
+// function to empty the command table, directories are kept
+void clearPathCache(void)
+{
+	for (int i = 0; i < PATH_TABLE_SIZE; i++)
+	{
+		// free every entry of the bucket
+		while (PATH_CACHE.buckets[i] != NULL)
+		{
+			struct pathEntry* entry = PATH_CACHE.buckets[i];
+			PATH_CACHE.buckets[i] = entry->next;
+			free(entry->name);
+			free(entry->path);
+			free(entry);
+		}
+	}
+}
+
+// function to read the modification time of every PATH directory, missing directories get 0
+void readPathMtimes(void)
+{
+	struct stat dirStat;
+	for (int i = 0; i < PATH_CACHE.dirCount; i++)
+	{
+		if (stat(PATH_CACHE.dirs[i], &dirStat) == 0) {
+			PATH_CACHE.dirMtimes[i] = dirStat.st_mtim;
+		}
+		else {
+			PATH_CACHE.dirMtimes[i] = (struct timespec){ 0, 0 };
+		}
+	}
+}
+
+// function to split PATH into directories when it changed since the last lookup, the table is emptied then
+void refreshPathDirs(void)
+{
+	// execvp uses this when PATH is unset
+	char* path = getenv("PATH");
+	if (path == NULL) {
+		path = "/bin:/usr/bin";
+	}
+
+	// nothing to do if PATH is the one the table was built for
+	if (PATH_CACHE.pathCopy != NULL && strcmp(PATH_CACHE.pathCopy, path) == 0) {
+		return;
+	}
+
+	// forget commands and directories of the old PATH
+	clearPathCache();
+	free(PATH_CACHE.pathCopy);
+	free(PATH_CACHE.dirs);
+	free(PATH_CACHE.dirMtimes);
+
+	// one directory per : separated entry
+	PATH_CACHE.dirCount = 1;
+	for (char* c = path; *c; c++) {
+		if (*c == ':') {
+			PATH_CACHE.dirCount++;
+		}
+	}
+
+	// split a second copy of PATH in place, an empty entry means the current directory
+	free(PATH_CACHE.dirBuffer);
+	PATH_CACHE.pathCopy = strdup(path);
+	PATH_CACHE.dirBuffer = strdup(path);
+	PATH_CACHE.dirs = malloc(PATH_CACHE.dirCount * sizeof(char*));
+	PATH_CACHE.dirMtimes = malloc(PATH_CACHE.dirCount * sizeof(struct timespec));
+	char* dir = PATH_CACHE.dirBuffer;
+	for (int i = 0; i < PATH_CACHE.dirCount; i++)
+	{
+		char* colon = strchr(dir, ':');
+		PATH_CACHE.dirs[i] = *dir && dir != colon ? dir : ".";
+		if (colon != NULL) {
+			*colon = '\0';
+			dir = colon + 1;
+		}
+	}
+	readPathMtimes();
+}
+
+// function to check that PATH directories up to and including dirIndex did not change, a new command there would win
+bool pathDirsUnchanged(int dirIndex)
+{
+	struct stat dirStat;
+	for (int i = 0; i <= dirIndex; i++)
+	{
+		// a directory that cannot be read anymore counts as changed unless it was missing before too
+		struct timespec mtime = { 0, 0 };
+		if (stat(PATH_CACHE.dirs[i], &dirStat) == 0) {
+			mtime = dirStat.st_mtim;
+		}
+		if (mtime.tv_sec != PATH_CACHE.dirMtimes[i].tv_sec || mtime.tv_nsec != PATH_CACHE.dirMtimes[i].tv_nsec) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// function to find a command on PATH, cached lookups skip the directory walk. returns NULL if it is not found
+char* lookupCommand(char* command)
+{
+	// a command with a / is a path already
+	if (strchr(command, '/') != NULL) {
+		return command;
+	}
+
+	refreshPathDirs();
+
+	// look in the table first
+	unsigned int bucket = hashString(command, PATH_TABLE_SIZE);
+	for (struct pathEntry* entry = PATH_CACHE.buckets[bucket]; entry != NULL; entry = entry->next)
+	{
+		if (strcmp(entry->name, command) != 0) {
+			continue;
+		}
+
+		// hit, every directory before the one with the command was skipped
+		if (pathDirsUnchanged(entry->dirIndex)) {
+			entry->hits++;
+			PATH_CACHE.hits++;
+			PATH_CACHE.execsSaved += entry->dirIndex;
+			return entry->path;
+		}
+
+		// a directory changed, nothing in the table can be trusted
+		clearPathCache();
+		readPathMtimes();
+		break;
+	}
+	PATH_CACHE.misses++;
+
+	// walk PATH like execvp would
+	struct stat commandStat;
+	for (int i = 0; i < PATH_CACHE.dirCount; i++)
+	{
+		// build dir/command
+		char* path = malloc(strlen(PATH_CACHE.dirs[i]) + strlen(command) + 2);
+		sprintf(path, "%s/%s", PATH_CACHE.dirs[i], command);
+
+		// an executable regular file is what exec would run
+		if (stat(path, &commandStat) == 0 && S_ISREG(commandStat.st_mode) && access(path, X_OK) == 0)
+		{
+			// a relative directory moves with cd, those are looked up every time
+			if (PATH_CACHE.dirs[i][0] != '/') {
+				free(PATH_CACHE.lastRelative);
+				PATH_CACHE.lastRelative = path;
+				return path;
+			}
+
+			// put the command in the table
+			struct pathEntry* entry = malloc(sizeof(struct pathEntry));
+			entry->name = strdup(command);
+			entry->path = path;
+			entry->dirIndex = i;
+			entry->hits = 0;
+			entry->next = PATH_CACHE.buckets[bucket];
+			PATH_CACHE.buckets[bucket] = entry;
+			return path;
+		}
+		free(path);
+	}
+
+	// command is not anywhere on PATH
+	return NULL;
+}
+
+// function for hash command, lists the command table, -r empties it and command names are looked up ahead of time
+int hashCommand(char* argv[], struct shellState* shell)
+{
+	int status = 0;
+
+	// no arguments, print every command in the table and how much the table saved
+	if (argv[1] == NULL) {
+		refreshPathDirs();
+		printf("hits\tcommand\n");
+		for (int i = 0; i < PATH_TABLE_SIZE; i++)
+		{
+			for (struct pathEntry* entry = PATH_CACHE.buckets[i]; entry != NULL; entry = entry->next)
+			{
+				printf("%4d\t%s\n", entry->hits, entry->path);
+			}
+		}
+		printf("%ld lookups saved, %ld misses, %ld failed execs avoided\n", PATH_CACHE.hits, PATH_CACHE.misses, PATH_CACHE.execsSaved);
+		fflush(stdout);
+		return 0;
+	}
+
+	// loop thru arguments
+	for (int i = 1; argv[i] != NULL; i++)
+	{
+		// -r empties the table
+		if (strcmp(argv[i], "-r") == 0) {
+			clearPathCache();
+			continue;
+		}
+
+		// pre-warm the table, send message and 1 status if command is not found
+		if (lookupCommand(argv[i]) == NULL) {
+			printf("hash: %s not found\n", argv[i]);
+			fflush(stdout);
+			status = 1;
+		}
+	}
+	return status;
+}
+
+// function to open every output file of a stage and start a fan-out relay into them, returns the pipe the stage writes into or -1
+int openFanout(struct pipelineStage* stage, int outputCount, pid_t* fanoutPid)
+{
+	// open the files in the order they were given, stop at the first one that fails
+	int targetFDs[outputCount];
+	int opened = 0;
+	for (int i = 0; i < stage->redirectionCount && opened < outputCount; i++)
+	{
+		if (stage->redirections[i].fd == 1 && stage->redirections[i].path != NULL) {
+			targetFDs[opened] = openOutputFile(&stage->redirections[i]);
+			if (targetFDs[opened] == -1) {
+				break;
+			}
+			opened++;
+		}
+	}
+
+	// the stage writes into a pipe, a bigger pipe means fewer tee rounds in the relay
+	int fanoutPipe[2] = { -1, -1 };
+	if (opened == outputCount && pipe2(fanoutPipe, O_CLOEXEC) == 0)
+	{
+		fcntl(fanoutPipe[1], F_SETPIPE_SZ, FANOUT_PIPE_SIZE);
+		*fanoutPid = startFanout(fanoutPipe[0], targetFDs, outputCount);
+		close(fanoutPipe[0]);
+		if (*fanoutPid == -1) {
+			close(fanoutPipe[1]);
+			fanoutPipe[1] = -1;
+		}
+	}
+
+	// the relay has its own copies of the files
+	for (int i = 0; i < opened; i++)
+	{
+		close(targetFDs[i]);
+	}
+	return fanoutPipe[1];
+}
+
+// function to open the redirection files of a stage in the shell, fds are close-on-exec and -1 if there is no file.
+// a stage with more than one output file writes into a fan-out relay, fanoutPid is its pid and -1 if there is none
+int openStageFiles(struct pipelineStage* stage, bool background, bool pipedIn, bool pipedOut, int* sourceFD, int* targetFD, pid_t* fanoutPid)
+{
+	//  string for null
+	char null[] = "/dev/null";
+
+	// files given with <, > and >>
+	char* inputSource = redirectionPath(stage, 0);
+	int outputCount = countRedirections(stage, 1);
+
+	*sourceFD = -1;
+	*targetFD = -1;
+	*fanoutPid = -1;
+
+	// redirect input if necessary, /dev/null for a background process without one
+	if (inputSource != NULL || (background && !pipedIn))
+	{
+		// open source file
+		if (inputSource == NULL) {
+			inputSource = null;
+		}
+		*sourceFD = open(inputSource, O_RDONLY | O_CLOEXEC);
+
+		// source file cannot be opened, send message
+		if (*sourceFD == -1) {
+			printf("cannot open %s for input\n", inputSource);
+			fflush(stdout);
+			return -1;
+		}
+	}
+
+	// redirect output if necssary, /dev/null for a background process without one
+	if (outputCount > 0 || (background && !pipedOut))
+	{
+		// open the file and set permissions, more than one file goes through the fan-out relay
+		if (outputCount == 1) {
+			*targetFD = openOutputFile(findRedirection(stage, 1));
+		}
+		else if (outputCount > 1) {
+			*targetFD = openFanout(stage, outputCount, fanoutPid);
+		}
+		else if ((*targetFD = open(null, O_WRONLY | O_CLOEXEC)) == -1) {
+			printf("cannot open %s for output\n", null);
+			fflush(stdout);
+		}
+
+		// file cannot be opened, the message is out already
+		if (*targetFD == -1) {
+			if (*sourceFD != -1) {
+				close(*sourceFD);
+			}
+			return -1;
+		}
+	}
+	return 0;
+}
+
+// function to read a cpu list like 0-7,9 into cpus, returns -1 if it is not one or names no cpu
+int parseCpuList(const char* list, cpu_set_t* cpus)
+{
+	CPU_ZERO(cpus);
+	const char* c = list;
+	while (*c != '\0')
+	{
+		// a cpu number or a range of them
+		if (!isdigit((unsigned char)*c)) {
+			return -1;
+		}
+		char* end;
+		long first = strtol(c, &end, 10), last = first;
+		if (*end == '-') {
+			if (!isdigit((unsigned char)end[1])) {
+				return -1;
+			}
+			last = strtol(end + 1, &end, 10);
+		}
+		if (last < first || last >= CPU_SETSIZE) {
+			return -1;
+		}
+		for (long cpu = first; cpu <= last; cpu++) {
+			CPU_SET(cpu, cpus);
+		}
+
+		// ranges are split by commas
+		c = end;
+		if (*c == ',' && c[1] != '\0') {
+			c++;
+		}
+		else if (*c != '\0') {
+			return -1;
+		}
+	}
+	return CPU_COUNT(cpus) > 0 ? 0 : -1;
+}
+
+// function to write cpus as a cpu list like 0-7,9
+void formatCpuList(cpu_set_t* cpus, char* buffer, size_t size)
+{
+	size_t used = 0;
+	buffer[0] = '\0';
+	for (int cpu = 0; cpu < CPU_SETSIZE && used < size; cpu++)
+	{
+		if (!CPU_ISSET(cpu, cpus)) {
+			continue;
+		}
+		int last = cpu;
+		while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, cpus)) {
+			last++;
+		}
+		if (last == cpu) {
+			used += snprintf(buffer + used, size - used, "%s%d", used ? "," : "", cpu);
+		}
+		else {
+			used += snprintf(buffer + used, size - used, "%s%d-%d", used ? "," : "", cpu, last);
+		}
+		cpu = last;
+	}
+}
+
+// function to read the cpus the shell may use and the NUMA nodes they belong to, once. without NUMA every cpu is in node 0
+void loadTopology(void)
+{
+	if (TOPOLOGY.loaded) {
+		return;
+	}
+	TOPOLOGY.loaded = true;
+	if (sched_getaffinity(0, sizeof(cpu_set_t), &TOPOLOGY.allowed) == -1) {
+		CPU_ZERO(&TOPOLOGY.allowed);
+		CPU_SET(0, &TOPOLOGY.allowed);
+	}
+
+	// every node directory has the list of its cpus, nodes without a cpu the shell may use are left out
+	DIR* nodes = opendir("/sys/devices/system/node");
+	struct dirent* entry;
+	while (nodes != NULL && (entry = readdir(nodes)) != NULL)
+	{
+		int id;
+		char path[300], list[4096];
+		if (sscanf(entry->d_name, "node%d", &id) != 1) {
+			continue;
+		}
+		snprintf(path, sizeof(path), "/sys/devices/system/node/%s/cpulist", entry->d_name);
+		int listFD = open(path, O_RDONLY | O_CLOEXEC);
+		if (listFD == -1) {
+			continue;
+		}
+		ssize_t length = read(listFD, list, sizeof(list) - 1);
+		close(listFD);
+		list[length > 0 ? length : 0] = '\0';
+		list[strcspn(list, "\n")] = '\0';
+
+		cpu_set_t cpus;
+		if (parseCpuList(list, &cpus) == -1) {
+			continue;
+		}
+		CPU_AND(&cpus, &cpus, &TOPOLOGY.allowed);
+		if (CPU_COUNT(&cpus) == 0) {
+			continue;
+		}
+
+		// nodes are kept in id order
+		TOPOLOGY.nodeIds = realloc(TOPOLOGY.nodeIds, (TOPOLOGY.nodeCount + 1) * sizeof(int));
+		TOPOLOGY.nodeCpus = realloc(TOPOLOGY.nodeCpus, (TOPOLOGY.nodeCount + 1) * sizeof(cpu_set_t));
+		int i = TOPOLOGY.nodeCount++;
+		while (i > 0 && TOPOLOGY.nodeIds[i - 1] > id) {
+			TOPOLOGY.nodeIds[i] = TOPOLOGY.nodeIds[i - 1];
+			TOPOLOGY.nodeCpus[i] = TOPOLOGY.nodeCpus[i - 1];
+			i--;
+		}
+		TOPOLOGY.nodeIds[i] = id;
+		TOPOLOGY.nodeCpus[i] = cpus;
+	}
+	if (nodes != NULL) {
+		closedir(nodes);
+	}
+
+	// no NUMA support in the kernel
+	if (TOPOLOGY.nodeCount == 0) {
+		TOPOLOGY.nodeIds = malloc(sizeof(int));
+		TOPOLOGY.nodeCpus = malloc(sizeof(cpu_set_t));
+		TOPOLOGY.nodeIds[0] = 0;
+		TOPOLOGY.nodeCpus[0] = TOPOLOGY.allowed;
+		TOPOLOGY.nodeCount = 1;
+	}
+}
+
+// function to find the node of a cpu, as an index into the topology
+int nodeOfCpu(int cpu)
+{
+	for (int i = 0; i < TOPOLOGY.nodeCount; i++)
+	{
+		if (CPU_ISSET(cpu, &TOPOLOGY.nodeCpus[i])) {
+			return i;
+		}
+	}
+	return 0;
+}
+
+// function to pick where the next background job runs under set placement=. roundrobin and compact give it one cpu,
+// numa gives it every cpu of a node. running jobs are counted from the job table
+void choosePlacement(struct placement* placement)
+{
+	loadTopology();
+
+	// running jobs on every cpu and every node
+	int cpuJobs[CPU_SETSIZE] = {0};
+	int nodeJobs[TOPOLOGY.nodeCount];
+	memset(nodeJobs, 0, sizeof(nodeJobs));
+	for (int i = 0; i < JOB_TABLE.capacity; i++)
+	{
+		struct job* job = &JOB_TABLE.jobs[i];
+		if (job->pid == 0 || job->cpus == NULL) {
+			continue;
+		}
+		for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+			cpuJobs[cpu] += CPU_ISSET(cpu, job->cpus) ? 1 : 0;
+		}
+		for (int node = 0; node < TOPOLOGY.nodeCount; node++) {
+			nodeJobs[node] += TOPOLOGY.nodeIds[node] == job->node ? 1 : 0;
+		}
+	}
+
+	int chosen = -1;
+	CPU_ZERO(&placement->cpus);
+	if (PLACEMENT == PLACEMENT_NUMA)
+	{
+		// the node with the fewest jobs, the first one on a tie
+		int node = 0;
+		for (int i = 1; i < TOPOLOGY.nodeCount; i++) {
+			if (nodeJobs[i] < nodeJobs[node]) {
+				node = i;
+			}
+		}
+		placement->cpus = TOPOLOGY.nodeCpus[node];
+		placement->node = TOPOLOGY.nodeIds[node];
+		return;
+	}
+	else if (PLACEMENT == PLACEMENT_ROUNDROBIN)
+	{
+		// the next cpu after the one the last job got
+		for (int i = 0; i < CPU_SETSIZE && chosen == -1; i++)
+		{
+			int cpu = (TOPOLOGY.nextCpu + i) % CPU_SETSIZE;
+			if (CPU_ISSET(cpu, &TOPOLOGY.allowed)) {
+				chosen = cpu;
+			}
+		}
+		TOPOLOGY.nextCpu = chosen + 1;
+	}
+	else
+	{
+		// the lowest cpu with the fewest jobs, so jobs pack onto neighbouring cores
+		for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+		{
+			if (CPU_ISSET(cpu, &TOPOLOGY.allowed) && (chosen == -1 || cpuJobs[cpu] < cpuJobs[chosen])) {
+				chosen = cpu;
+			}
+		}
+	}
+	CPU_SET(chosen, &placement->cpus);
+	placement->node = TOPOLOGY.nodeIds[nodeOfCpu(chosen)];
+}
+
+// function to move the shell onto the cpus and memory node of a placement so the processes it starts next inherit them,
+// saved gets what to go back to. memory is only preferred from the node when there is more than one. returns -1 if the cpus cannot be used
+int enterPlacement(struct placement* placement, struct savedPlacement* saved)
+{
+	saved->memory = false;
+	if (sched_getaffinity(0, sizeof(cpu_set_t), &saved->cpus) == -1 || sched_setaffinity(0, sizeof(cpu_set_t), &placement->cpus) == -1) {
+		perror("placement");
+		fflush(stdout);
+		return -1;
+	}
+
+	// a preferred node lets memory come from other nodes when the node is full instead of failing
+	loadTopology();
+	if (TOPOLOGY.nodeCount > 1 && placement->node >= 0 && placement->node < (int)(8 * sizeof(saved->nodeMask)))
+	{
+		unsigned long nodeMask[sizeof(saved->nodeMask) / sizeof(unsigned long)] = {0};
+		nodeMask[placement->node / (8 * sizeof(unsigned long))] = 1UL << (placement->node % (8 * sizeof(unsigned long)));
+		if (syscall(SYS_get_mempolicy, &saved->memoryMode, saved->nodeMask, 8 * sizeof(saved->nodeMask), NULL, 0) == 0
+			&& syscall(SYS_set_mempolicy, MPOL_PREFERRED, nodeMask, 8 * sizeof(nodeMask)) == 0) {
+			saved->memory = true;
+		}
+	}
+	return 0;
+}
+
+// function to put the shell back where it was before enterPlacement
+void leavePlacement(struct savedPlacement* saved)
+{
+	sched_setaffinity(0, sizeof(cpu_set_t), &saved->cpus);
+	if (saved->memory) {
+		syscall(SYS_set_mempolicy, saved->memoryMode, saved->memoryMode == MPOL_DEFAULT ? NULL : saved->nodeMask, 8 * sizeof(saved->nodeMask));
+	}
+}
+
+// function to report a failed exec from a fork or vfork child, only write() so the parent's stdio is left alone
+void childExecError(char* command)
+{
+	char* reason = strerror(errno);
+	write(STDERR_FILENO, command, strlen(command));
+	write(STDERR_FILENO, ": ", 2);
+	write(STDERR_FILENO, reason, strlen(reason));
+	write(STDERR_FILENO, "\n", 1);
+}
+
+// function to start a process with fork or vfork, signal setup and redirection happen in the child. group is the process group to join, 0 for a new one, -1 for the shell's
+pid_t spawnWithFork(char* argv[], char* commandPath, int inFD, int outFD, int errFD, bool background, pid_t group)
+{
+	// block every signal so neither child nor a vfork-suspended parent runs the shell's handlers halfway through
+	sigset_t allSignals, oldMask;
+	sigfillset(&allSignals);
+	sigprocmask(SIG_SETMASK, &allSignals, &oldMask);
+
+	// If fork is successful, the value of spawnpid will be 0 in the child, the child's pid in the parent
+	pid_t childProcess = (SPAWN_MODE == SPAWN_VFORK) ? vfork() : fork();
+	if (childProcess == 0)
+	{
+		// a vfork child shares the parent's memory, so only touch its own stack
+		struct sigaction childAction = {0};
+
+		// ^Z in the foreground is for the shell. a background job is in a process group of its own, the terminal only
+		// sends it ^C and ^Z once fg hands the terminal to it, so it gets the default actions of both
+		childAction.sa_handler = background ? SIG_DFL : SIG_IGN;
+		sigfillset(&childAction.sa_mask);  // Block all catchable signals while handle_SIGTSTP is running
+		childAction.sa_flags = 0;   // No flags set
+		sigaction(SIGTSTP, &childAction, NULL);
+
+		// foreground processes can be interrupted, background ones once they are brought back with fg
+		childAction.sa_handler = background ? SIG_DFL : handle_SIGINT;
+		sigaction(SIGINT, &childAction, NULL);
+
+		// the shell ignores SIGTTOU to hand the terminal back after fg, a command gets the default
+		childAction.sa_handler = SIG_DFL;
+		sigaction(SIGTTOU, &childAction, NULL);
+
+		// a background job gets a process group of its own
+		if (group != -1) {
+			setpgid(0, group);
+		}
+
+		// Redirect stdin and stdout
+		if (inFD != -1) {
+			dup2(inFD, 0);
+		}
+		if (outFD != -1) {
+			dup2(outFD, 1);
+		}
+		if (errFD != -1) {
+			dup2(errFD, 2);
+		}
+
+		// give the command a clean signal mask, the shell keeps SIGCHLD blocked for its signalfd, and call execv function
+		sigset_t emptyMask;
+		sigemptyset(&emptyMask);
+		sigprocmask(SIG_SETMASK, &emptyMask, NULL);
+		execv(commandPath, argv);
+		// exec only returns if there is an error, send 2 as signal
+		childExecError(argv[0]);
+		_exit(2);
+	}
+
+	// fork fails send message
+	if (childProcess == -1) {
+		perror("Command failed! Please try again!");
+		fflush(stdout);
+	}
+	// the parent sets the group too, so it exists before the next stage joins it whichever runs first
+	else if (group != -1) {
+		setpgid(childProcess, group ? group : childProcess);
+	}
+	sigprocmask(SIG_SETMASK, &oldMask, NULL);
+	return childProcess;
+}
+
+// function to start a process with posix_spawn, signal setup and redirection are described up front. group is like for spawnWithFork
+pid_t spawnWithPosixSpawn(char* argv[], char* commandPath, int inFD, int outFD, int errFD, bool background, pid_t group)
+{
+	pid_t childProcess = -1;
+	posix_spawnattr_t attributes;
+	posix_spawn_file_actions_t fileActions;
+
+	// signals the child gets back as default and the empty mask it starts with
+	sigset_t defaultSignals, emptyMask;
+	sigemptyset(&defaultSignals);
+	sigemptyset(&emptyMask);
+
+	// shell ignores ^C and SIGTTOU for fg, a process gets the default actions back. ^Z stays ignored in the foreground,
+	// a background job in its own process group gets it as well so it can be stopped once fg hands it the terminal
+	sigaddset(&defaultSignals, SIGINT);
+	if (background) {
+		sigaddset(&defaultSignals, SIGTSTP);
+	}
+	sigaddset(&defaultSignals, SIGTTOU);
+
+	posix_spawnattr_init(&attributes);
+	posix_spawnattr_setsigdefault(&attributes, &defaultSignals);
+	posix_spawnattr_setsigmask(&attributes, &emptyMask);
+	posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK | (group != -1 ? POSIX_SPAWN_SETPGROUP : 0));
+	if (group != -1) {
+		posix_spawnattr_setpgroup(&attributes, group);
+	}
+
+	// Redirect stdin and stdout
+	posix_spawn_file_actions_init(&fileActions);
+	if (inFD != -1) {
+		posix_spawn_file_actions_adddup2(&fileActions, inFD, 0);
+	}
+	if (outFD != -1) {
+		posix_spawn_file_actions_adddup2(&fileActions, outFD, 1);
+	}
+	if (errFD != -1) {
+		posix_spawn_file_actions_adddup2(&fileActions, errFD, 2);
+	}
+
+	// a caught ^Z goes back to default across exec, so ignore it in the shell for the length of the spawn
+	struct sigaction ignoreAction = {0}, oldAction;
+	sigset_t tstpSignal, oldMask;
+	sigemptyset(&tstpSignal);
+	sigaddset(&tstpSignal, SIGTSTP);
+	ignoreAction.sa_handler = SIG_IGN;
+	sigprocmask(SIG_BLOCK, &tstpSignal, &oldMask);
+	sigaction(SIGTSTP, &ignoreAction, &oldAction);
+
+	int result = posix_spawn(&childProcess, commandPath, &fileActions, &attributes, argv, environ);
+
+	// put the handler back, a ^Z that came in meanwhile is delivered now
+	sigaction(SIGTSTP, &oldAction, NULL);
+	sigprocmask(SIG_SETMASK, &oldMask, NULL);
+
+	posix_spawn_file_actions_destroy(&fileActions);
+	posix_spawnattr_destroy(&attributes);
+
+	// spawn reports a failed exec to the shell instead of the child
+	if (result != 0) {
+		errno = result;
+		perror(argv[0]);
+		fflush(stdout);
+		return -1;
+	}
+	return childProcess;
+}
+
+// builtins and functions are looked up again for the stages of a pipeline, they are defined below
+struct builtin* findBuiltin(char* name);
+extern struct builtin FUNCTION_CALL;
+
+// function to run a builtin or function that is one stage of a pipeline in a fork of the shell, so it can read and write the pipes like
+// a program. the builtin sees the shell as it was, whatever it changes is gone with the fork. group is like for spawnWithFork
+pid_t spawnBuiltin(struct builtin* builtin, char* argv[], int inFD, int outFD, int errFD, bool background, pid_t group)
+{
+	fflush(stdout);
+	pid_t childProcess = fork();
+	if (childProcess == 0)
+	{
+		// the fork is a stage like any other: ^C ends it, ^Z is for the shell unless the stage is part of a background job
+		struct sigaction childAction = {0};
+		sigfillset(&childAction.sa_mask);
+		childAction.sa_handler = background ? SIG_DFL : SIG_IGN;
+		sigaction(SIGTSTP, &childAction, NULL);
+		childAction.sa_handler = SIG_DFL;
+		sigaction(SIGINT, &childAction, NULL);
+		if (group != -1) {
+			setpgid(0, group);
+		}
+
+		if (inFD != -1) {
+			dup2(inFD, 0);
+		}
+		if (outFD != -1) {
+			dup2(outFD, 1);
+		}
+		if (errFD != -1) {
+			dup2(errFD, 2);
+		}
+
+		// a shell of its own for the builtin, with the status the line started with
+		struct arena arena = {0};
+		struct lineReader input = { -1, NULL, 0, 0, 0, true, false, false };
+		struct shellState shell = { LAST_STATUS, &arena, &input, false, false };
+		shell.inputRedirected = inFD != -1;
+		int status = builtin->run(argv, &shell);
+		fflush(stdout);
+		exit(status == -1 ? 1 : status);
+	}
+
+	// fork fails send message
+	if (childProcess == -1) {
+		perror("Command failed! Please try again!");
+		fflush(stdout);
+	}
+	// the parent sets the group too, like for spawnWithFork
+	else if (group != -1) {
+		setpgid(childProcess, group ? group : childProcess);
+	}
+	return childProcess;
+}
+
+// function to start one process with the spawn engine picked by set spawn=, in process group group (0 new, -1 the shell's). returns -1 if nothing runs.
+// a function or a builtin that does not stand in for a program runs in a fork of the shell instead
+pid_t spawnProcess(char* argv[], int inFD, int outFD, int errFD, bool background, pid_t group)
+{
+	struct builtin* builtin = findFunction(argv[0]) != NULL ? &FUNCTION_CALL : findBuiltin(argv[0]);
+	if (builtin != NULL && !builtin->replacesProgram) {
+		return spawnBuiltin(builtin, argv, inFD, outFD, errFD, background, group);
+	}
+
+	// find the command through the command table, the child execs the full path directly
+	char* commandPath = lookupCommand(argv[0]);
+	if (commandPath == NULL) {
+		errno = ENOENT;
+		perror(argv[0]);
+		fflush(stdout);
+		return -1;
+	}
+
+	if (SPAWN_MODE == SPAWN_POSIX_SPAWN) {
+		return spawnWithPosixSpawn(argv, commandPath, inFD, outFD, errFD, background, group);
+	}
+	return spawnWithFork(argv, commandPath, inFD, outFD, errFD, background, group);
+}
+
+// function to start every stage of a pipeline, each stage gets its own pipe to the next one. pipelineErr is stderr of every stage, -1 to inherit.
+// fanoutPids get the fan-out relay of every stage with more than one output file, -1 for the others. every process starts inside placement unless it is NULL.
+// returns -1 if a pipe cannot be made, the stages already started are killed then and every pid is -1
+int launchPipeline(struct pipelineStage stages[], int stageCount, int pipelineIn, int pipelineOut, int pipelineErr, bool background, pid_t stagePids[], pid_t fanoutPids[], struct placement* placement)
+{
+	// read end of the pipe coming from the previous stage
+	int previousRead = pipelineIn;
+
+	// children inherit affinity and memory policy through fork, vfork and posix_spawn alike, so the shell takes them on while it starts the stages
+	struct savedPlacement saved;
+	bool placed = placement != NULL && enterPlacement(placement, &saved) == 0;
+
+	// a background pipeline is one process group led by its first stage, so a job can be signalled as a whole
+	pid_t group = background ? 0 : -1;
+
+	for (int i = 0; i < stageCount; i++)
+	{
+		// every stage but the last one writes into a fresh pipe, close-on-exec so only stdin and stdout survive
+		int pipeFDs[2] = { -1, -1 };
+		if (i < stageCount - 1 && pipe2(pipeFDs, O_CLOEXEC) == -1) {
+			perror("pipe");
+			fflush(stdout);
+
+			// a pipeline with a stage missing in the middle is not run at all
+			if (previousRead != -1) {
+				close(previousRead);
+			}
+			if (pipelineOut != -1) {
+				close(pipelineOut);
+			}
+			for (int j = i; j < stageCount; j++)
+			{
+				stagePids[j] = -1;
+				fanoutPids[j] = -1;
+			}
+			killProcesses(stagePids, i);
+			killProcesses(fanoutPids, i);
+			if (placed) {
+				leavePlacement(&saved);
+			}
+			return -1;
+		}
+		int stageOut = (i < stageCount - 1) ? pipeFDs[1] : pipelineOut;
+
+		// a file wins over the pipe like in other shells, a stage whose file cannot be opened does not run
+		int sourceFD, targetFD;
+		stagePids[i] = -1;
+		if (openStageFiles(&stages[i], background, previousRead != -1, stageOut != -1, &sourceFD, &targetFD, &fanoutPids[i]) == 0)
+		{
+			stagePids[i] = spawnProcess(stages[i].argv, sourceFD != -1 ? sourceFD : previousRead, targetFD != -1 ? targetFD : stageOut, pipelineErr, background, group);
+			if (group == 0 && stagePids[i] != -1) {
+				group = stagePids[i];
+			}
+
+			// the child has its own copies now
+			if (sourceFD != -1) {
+				close(sourceFD);
+			}
+			if (targetFD != -1) {
+				close(targetFD);
+			}
+		}
+
+		// the shell keeps no pipe ends, otherwise readers never see EOF
+		if (previousRead != -1) {
+			close(previousRead);
+		}
+		if (pipeFDs[1] != -1) {
+			close(pipeFDs[1]);
+		}
+		previousRead = pipeFDs[0];
+	}
+	if (placed) {
+		leavePlacement(&saved);
+	}
+
+	// the output relay pipe belongs to the last stage now
+	if (pipelineOut != -1) {
+		close(pipelineOut);
+	}
+	return 0;
+}
+
+// function to get the status of a pipeline from the status of its stages, signalNumber is the signal that killed the deciding stage or 0
+int pipelineStatus(int stageStatus[], int stageSignal[], int stageCount, int* signalNumber)
+{
+	// status comes from the last stage, or from the rightmost failing stage in pipefail mode
+	int decidingStage = stageCount - 1;
+	if (PIPEFAIL) {
+		for (int i = stageCount - 1; i >= 0; i--)
+		{
+			if (stageStatus[i] != 0) {
+				decidingStage = i;
+				break;
+			}
+		}
+	}
+	*signalNumber = stageSignal[decidingStage];
+	return stageStatus[decidingStage];
+}
+
+// run command in foreground, on the cpus of placement unless it is NULL
+int runInForeground(struct pipelineStage stages[], int stageCount, struct placement* placement)
+{
+	int status = 0;				// status to be returned
+	int childStatus;
+
+	// pids and shell status of every stage, pids of the relays if any
+	pid_t stagePids[stageCount];
+	pid_t fanoutPids[stageCount];
+	int stageStatus[stageCount];
+	int stageSignal[stageCount];
+	pid_t relayPids[2] = { -1, -1 };
+
+	// fds of the relay pipes at both ends of the pipeline, -1 if there is no relay
+	int pipelineIn = -1;
+	int pipelineOut = -1;
+
+	// put splice relays between the redirection files and the pipeline if asked to
+	if (SPLICE_RELAY && openRelays(stages, stageCount, &pipelineIn, &pipelineOut, relayPids) == -1) {
+		return 1;
+	}
+
+	// fork the whole pipeline, the clock starts before the first fork
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (launchPipeline(stages, stageCount, pipelineIn, pipelineOut, -1, false, stagePids, fanoutPids, placement) == -1) {
+		killProcesses(relayPids, 2);
+		return 1;
+	}
+
+	// wait for every stage of the pipeline, retry if ^Z interrupts the wait. wait4 also hands back what the stage used
+	struct rusage total = {0}, usage;
+	for (int i = 0; i < stageCount; i++)
+	{
+		// stage that never started failed like a command that cannot be executed
+		if (stagePids[i] == -1) {
+			stageStatus[i] = 1;
+			stageSignal[i] = 0;
+			continue;
+		}
+		while (wait4(stagePids[i], &childStatus, 0, &usage) == -1 && errno == EINTR);
+		stageStatus[i] = convertStatus(childStatus, &stageSignal[i]);
+		addUsage(&total, &usage);
+	}
+
+	// keep what the job used for status -v and time
+	LAST_USAGE.wall = elapsedSince(&start);
+	LAST_USAGE.usage = total;
+	LAST_USAGE.stageCount = stageCount;
+	snprintf(LAST_USAGE.command, sizeof(LAST_USAGE.command), "%s", stages[0].argv[0]);
+	LAST_USAGE.count++;
+
+	// reap the relays, their status is not part of the pipeline
+	for (int i = 0; i < 2; i++)
+	{
+		if (relayPids[i] != -1) {
+			while (waitpid(relayPids[i], &childStatus, 0) == -1 && errno == EINTR);
+		}
+	}
+	for (int i = 0; i < stageCount; i++)
+	{
+		if (fanoutPids[i] != -1) {
+			while (waitpid(fanoutPids[i], &childStatus, 0) == -1 && errno == EINTR);
+		}
+	}
+
+	// abnormal termination due to signal
+	status = pipelineStatus(stageStatus, stageSignal, stageCount, &SIGNAL_NUMBER);
+	recordCommand(LAST_USAGE.command, false, &LAST_USAGE.wall, &total, status, SIGNAL_NUMBER);
+	if (SIGNAL_NUMBER != 0)
+	{
+		printf("terminated by signal %d\n", SIGNAL_NUMBER);
+		fflush(stdout);
+	}
+	return status;
+}
+
+// function to read a pipe until every writer is gone, into a malloc'd buffer that doubles as it fills.
+// big ones are moved by mremap in realloc so growing never copies. the pipe is closed
+void readPipe(int fd, char** output, size_t* length)
+{
+	size_t capacity = 65536;
+	*output = malloc(capacity);
+	*length = 0;
+
+	// read straight into the free end of the buffer
+	ssize_t count;
+	while ((count = read(fd, *output + *length, capacity - *length)) != 0)
+	{
+		if (count == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		*length += count;
+		if (*length == capacity) {
+			capacity *= 2;
+			*output = realloc(*output, capacity);
+		}
+	}
+	close(fd);
+}
+
+// function to run a pipeline with stdout on a pipe and read all of it, malloc'd. returns the status of the pipeline
+int captureOutput(struct pipelineStage stages[], int stageCount, char** output, size_t* length)
+{
+	pid_t stagePids[stageCount];
+	pid_t fanoutPids[stageCount];
+	int stageStatus[stageCount];
+	int stageSignal[stageCount];
+
+	int pipeFDs[2];
+	if (pipe2(pipeFDs, O_CLOEXEC) == -1) {
+		perror("pipe");
+		fflush(stdout);
+		*output = NULL;
+		*length = 0;
+		return 1;
+	}
+	fcntl(pipeFDs[0], F_SETPIPE_SZ, FANOUT_PIPE_SIZE);
+	if (launchPipeline(stages, stageCount, -1, pipeFDs[1], -1, false, stagePids, fanoutPids, NULL) == -1) {
+		close(pipeFDs[0]);
+		*output = NULL;
+		*length = 0;
+		return 1;
+	}
+	readPipe(pipeFDs[0], output, length);
+
+	// the stages and relays are waited for like in the foreground
+	int childStatus;
+	for (int i = 0; i < stageCount; i++)
+	{
+		stageStatus[i] = 1;
+		stageSignal[i] = 0;
+		if (stagePids[i] != -1) {
+			while (waitpid(stagePids[i], &childStatus, 0) == -1 && errno == EINTR);
+			stageStatus[i] = convertStatus(childStatus, &stageSignal[i]);
+		}
+		if (fanoutPids[i] != -1) {
+			while (waitpid(fanoutPids[i], &childStatus, 0) == -1 && errno == EINTR);
+		}
+	}
+	int signalNumber;
+	return pipelineStatus(stageStatus, stageSignal, stageCount, &signalNumber);
+}
+
+// a list in $( ) runs the list again in a child shell, defined below
+int runCommandList(struct commandNode* node, struct shellState* shell);
+
+// function to run a command list with stdout on a pipe and read all of it, malloc'd. a fork of the shell runs it, since the commands
+// of a list come one after the other while the output is read. returns the status of the list
+int captureList(struct commandNode* list, struct arena* arena, char** output, size_t* length)
+{
+	int pipeFDs[2];
+	if (pipe2(pipeFDs, O_CLOEXEC) == -1) {
+		perror("pipe");
+		fflush(stdout);
+		*output = NULL;
+		*length = 0;
+		return 1;
+	}
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		dup2(pipeFDs[1], STDOUT_FILENO);
+		struct lineReader input = { -1, NULL, 0, 0, 0, true, false, false };
+		struct shellState shell = { LAST_STATUS, arena, &input, false, false };
+		int status = runCommandList(list, &shell);
+		fflush(stdout);
+		exit(status == -1 ? 1 : status);
+	}
+	close(pipeFDs[1]);
+	readPipe(pipeFDs[0], output, length);
+
+	int childStatus, signalNumber;
+	if (pid == -1) {
+		perror("fork");
+		fflush(stdout);
+		return 1;
+	}
+	while (waitpid(pid, &childStatus, 0) == -1 && errno == EINTR);
+	return convertStatus(childStatus, &signalNumber);
+}
+
+// function to expand $(command) at c: the command is tokenized in the shell, so a nested $( ) runs right here too without a subshell,
+// and its output goes into the word with the new lines at the end removed. unquoted output is split into words at white space
+const char* substituteCommand(struct tokenizer* tok, const char* c, bool quoted)
+{
+	const char* end = substitutionEnd(c + 1);
+	if (end == NULL) {
+		tok->error = "Missing ) in command substitution in command line!";
+		return c + strlen(c);
+	}
+
+	// the command lives in the arena with the rest of the line
+	size_t commandLength = end - (c + 2);
+	char* command = arenaAlloc(tok->arena, commandLength + 1);
+	memcpy(command, c + 2, commandLength);
+	command[commandLength] = '\0';
+	char* listError;
+	struct commandNode* list = parseCommandList(tok->arena, command, &listError, NULL);
+	if (listError != NULL) {
+		tok->error = listError;
+		return end;
+	}
+	if (list == NULL) {
+		tok->wordSplit = tok->wordSplit || !quoted;
+		return end + 1;
+	}
+
+	// a single command runs straight from here, a list with ; && || or & needs a shell of its own
+	char* output;
+	size_t length;
+	if (list->type == NODE_COMMAND && !list->background) {
+		struct parsedCommand* inner = parseCommandLine(tok->arena, list->text);
+		if (inner->error != NULL) {
+			tok->error = inner->error;
+			return end;
+		}
+		if (inner->stageCount == 0) {
+			tok->wordSplit = tok->wordSplit || !quoted;
+			return end + 1;
+		}
+		captureOutput(inner->stages, inner->stageCount, &output, &length);
+	}
+	else {
+		captureList(list, tok->arena, &output, &length);
+	}
+	while (length > 0 && output[length - 1] == '\n') {
+		length--;
+	}
+
+	// quoted output is one word as it is
+	if (quoted) {
+		appendBytesToWord(tok, output, length);
+		free(output);
+		return end + 1;
+	}
+
+	splitIntoWords(tok, output, length);
+	free(output);
+	return end + 1;
+}
+
+// function to keep count bytes in a ring, only the last size bytes of everything written stay
+void ringWrite(struct outputRing* ring, const char* buffer, size_t count)
+{
+	if (count > ring->size) {
+		buffer += count - ring->size;
+		ring->total += count - ring->size;
+		count = ring->size;
+	}
+	size_t at = ring->total % ring->size;
+	size_t first = count < ring->size - at ? count : ring->size - at;
+	memcpy(ring->data + at, buffer, first);
+	memcpy(ring->data, buffer + first, count - first);
+	ring->total += count;
+}
+
+// function run by the capture thread: one epoll loop moves whatever background jobs write into their rings as soon as it comes,
+// so a job never waits for the shell. it uses no stdio and no malloc, children forked meanwhile find no lock of those held
+void* captureLoop(void* unused)
+{
+	// signals are for the main thread
+	sigset_t allSignals;
+	sigfillset(&allSignals);
+	pthread_sigmask(SIG_BLOCK, &allSignals, NULL);
+
+	static char buffer[65536];
+	struct epoll_event events[64];
+	while (true)
+	{
+		int ready = epoll_wait(CAPTURE_EPOLL_FD, events, 64, -1);
+		for (int e = 0; e < ready; e++)
+		{
+			struct outputRing* ring = events[e].data.ptr;
+			ssize_t count = read(ring->fd, buffer, sizeof(buffer));
+			if (count == -1 && (errno == EAGAIN || errno == EINTR)) {
+				continue;
+			}
+
+			// at end of file the ring is closed, the shell may free it from then on
+			pthread_mutex_lock(&CAPTURE_LOCK);
+			if (count > 0) {
+				ringWrite(ring, buffer, count);
+			}
+			else {
+				epoll_ctl(CAPTURE_EPOLL_FD, EPOLL_CTL_DEL, ring->fd, NULL);
+				close(ring->fd);
+				ring->fd = -1;
+				ring->open = false;
+			}
+			pthread_mutex_unlock(&CAPTURE_LOCK);
+		}
+	}
+	return NULL;
+}
+
+// function to give the output of a background job a ring of CAPTURE_SIZE bytes, fd is the read end of its pipe.
+// the capture thread starts with the first one, closed rings beyond FINISHED_JOB_COUNT are freed
+void captureJob(int fd, int number, pid_t pid)
+{
+	if (CAPTURE_EPOLL_FD == -1) {
+		pthread_t thread;
+		CAPTURE_EPOLL_FD = epoll_create1(EPOLL_CLOEXEC);
+		if (CAPTURE_EPOLL_FD == -1 || pthread_create(&thread, NULL, captureLoop, NULL) != 0) {
+			perror("capture");
+			fflush(stdout);
+			close(fd);
+			return;
+		}
+		pthread_detach(thread);
+	}
+
+	struct outputRing* ring = calloc(1, sizeof(struct outputRing));
+	ring->fd = fd;
+	ring->number = number;
+	ring->pid = pid;
+	ring->size = CAPTURE_SIZE;
+	ring->data = malloc(ring->size);
+	ring->open = true;
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+
+	// newest first, only the shell changes the list
+	pthread_mutex_lock(&CAPTURE_LOCK);
+	ring->next = CAPTURE_RINGS;
+	CAPTURE_RINGS = ring;
+	int closed = 0;
+	for (struct outputRing** link = &CAPTURE_RINGS; *link != NULL;)
+	{
+		struct outputRing* old = *link;
+		if (!old->open && ++closed > FINISHED_JOB_COUNT) {
+			*link = old->next;
+			free(old->data);
+			free(old);
+		}
+		else {
+			link = &old->next;
+		}
+	}
+	pthread_mutex_unlock(&CAPTURE_LOCK);
+
+	struct epoll_event event = { EPOLLIN, { .ptr = ring } };
+	epoll_ctl(CAPTURE_EPOLL_FD, EPOLL_CTL_ADD, fd, &event);
+}
+
+// function to print what a job wrote, as much as its ring kept. spec is %n, %% or a pid, NULL for the newest job. returns -1 if there is no such output
+int printCapture(char* spec)
+{
+	int number = -1;
+	pid_t pid = -1;
+	if (spec != NULL && spec[0] == '%' && isdigit((unsigned char)spec[1])) {
+		number = atoi(spec + 1);
+	}
+	else if (spec != NULL && isdigit((unsigned char)spec[0])) {
+		pid = atoi(spec);
+	}
+	else if (spec != NULL && strcmp(spec, "%%") != 0 && strcmp(spec, "%+") != 0) {
+		return -1;
+	}
+
+	// the output is copied out so the capture thread is not held up while it prints
+	char* output = NULL;
+	size_t length = 0;
+	unsigned long long total = 0;
+	pthread_mutex_lock(&CAPTURE_LOCK);
+	struct outputRing* ring = CAPTURE_RINGS;
+	while (ring != NULL && !(number == -1 && pid == -1) && ring->number != number && ring->pid != pid) {
+		ring = ring->next;
+	}
+	if (ring != NULL) {
+		total = ring->total;
+		length = total < ring->size ? total : ring->size;
+		output = malloc(length + 1);
+		size_t at = total % ring->size;
+		if (total > ring->size) {
+			memcpy(output, ring->data + at, ring->size - at);
+			memcpy(output + ring->size - at, ring->data, at);
+		}
+		else {
+			memcpy(output, ring->data, length);
+		}
+	}
+	pthread_mutex_unlock(&CAPTURE_LOCK);
+	if (ring == NULL) {
+		return -1;
+	}
+
+	if (total > length) {
+		printf("(first %llu bytes dropped)\n", total - length);
+	}
+	fflush(stdout);
+	writeAll(STDOUT_FILENO, output, length);
+	free(output);
+	return 0;
+}
+
+// function to put the words of a pipeline back together for jobs, malloc'd
+char* jobCommandText(struct pipelineStage stages[], int stageCount)
+{
+	size_t length = 1;
+	for (int i = 0; i < stageCount; i++) {
+		for (int j = 0; stages[i].argv[j] != NULL; j++) {
+			length += strlen(stages[i].argv[j]) + 3;
+		}
+	}
+	char* text = malloc(length);
+	char* end = text;
+	*end = '\0';
+	for (int i = 0; i < stageCount; i++)
+	{
+		if (i > 0) {
+			end = stpcpy(end, " | ");
+		}
+		for (int j = 0; stages[i].argv[j] != NULL; j++) {
+			end = stpcpy(end, j > 0 ? " " : "");
+			end = stpcpy(end, stages[i].argv[j]);
+		}
+	}
+	return text;
+}
+
+// run command in background, on the cpus of placement unless it is NULL. returns -1 if the pipeline could not be started
+int runInBackground(struct pipelineStage stages[], int stageCount, struct placement* placement)
+{
+	// pids of every stage, pids of the relays if any
+	pid_t stagePids[stageCount];
+	pid_t fanoutPids[stageCount];
+	pid_t relayPids[2] = { -1, -1 };
+
+	// fds of the relay pipes at both ends of the pipeline, -1 if there is no relay
+	int pipelineIn = -1;
+	int pipelineOut = -1;
+
+	// put splice relays between the redirection files and the pipeline if asked to
+	if (SPLICE_RELAY && openRelays(stages, stageCount, &pipelineIn, &pipelineOut, relayPids) == -1) {
+		return -1;
+	}
+
+	// with capture on, stdout and stderr the job has no file for share one pipe to the capture thread instead of /dev/null
+	int captureFDs[2] = { -1, -1 };
+	if (CAPTURE_SIZE > 0 && pipe2(captureFDs, O_CLOEXEC) == 0 && pipelineOut == -1) {
+		pipelineOut = fcntl(captureFDs[1], F_DUPFD_CLOEXEC, 0);
+	}
+
+	// fork the whole pipeline
+	if (launchPipeline(stages, stageCount, pipelineIn, pipelineOut, captureFDs[1], true, stagePids, fanoutPids, placement) == -1) {
+		for (int i = 0; i < 2; i++)
+		{
+			if (captureFDs[i] != -1) {
+				close(captureFDs[i]);
+			}
+		}
+		killProcesses(relayPids, 2);
+		return -1;
+	}
+
+	// every process goes in the job table under one job number, but only the last stage is reported to the user.
+	// stages share the process group of the first one that started, relays stay in the shell's group
+	int number = nextJobNumber();
+	pid_t group = 0;
+	for (int i = 0; i < stageCount; i++)
+	{
+		if (stagePids[i] != -1) {
+			struct job* job = addJob(stagePids[i], i < stageCount - 1);
+			group = group ? group : stagePids[i];
+			job->number = number;
+			job->group = group;
+			clock_gettime(CLOCK_MONOTONIC, &job->started);
+
+			// the last stage keeps the command for jobs and where the job was placed
+			if (i == stageCount - 1) {
+				job->command = jobCommandText(stages, stageCount);
+				if (placement != NULL) {
+					job->cpus = malloc(sizeof(cpu_set_t));
+					*job->cpus = placement->cpus;
+					job->node = placement->node;
+				}
+			}
+		}
+		if (fanoutPids[i] != -1) {
+			addJob(fanoutPids[i], true)->number = number;
+		}
+	}
+	for (int i = 0; i < 2; i++)
+	{
+		if (relayPids[i] != -1) {
+			addJob(relayPids[i], true)->number = number;
+		}
+	}
+
+	// only the job holds the write end now, the thread sees end of file when the job is done with it
+	if (captureFDs[1] != -1) {
+		close(captureFDs[1]);
+		if (group != 0) {
+			captureJob(captureFDs[0], number, stagePids[stageCount - 1] != -1 ? stagePids[stageCount - 1] : group);
+		}
+		else {
+			close(captureFDs[0]);
+		}
+	}
+
+	// print the background pid and where it runs, $! expands to it
+	if (stagePids[stageCount - 1] != -1) {
+		LAST_BACKGROUND_PID = stagePids[stageCount - 1];
+		printf("background pid is %d", stagePids[stageCount - 1]);
+		if (placement != NULL) {
+			char cpuList[256];
+			formatCpuList(&placement->cpus, cpuList, sizeof(cpuList));
+			printf(" on cpus %s", cpuList);
+		}
+		printf("\n");
+	}
+	return 0;
+}
+
+// function to check that the argv of every stage fits what exec accepts, prints why not and returns -1
+int checkArgumentSize(struct parsedCommand* userInput)
+{
+	// exec counts the strings and pointers of argv and of the environment against ARG_MAX
+	long argMax = sysconf(_SC_ARG_MAX);
+	size_t environmentSize = sizeof(char*);
+	for (char** variable = environ; *variable != NULL; variable++)
+	{
+		environmentSize += strlen(*variable) + 1 + sizeof(char*);
+	}
+
+	// the kernel takes no single string longer than 32 pages either
+	size_t stringMax = 32 * sysconf(_SC_PAGESIZE);
+
+	for (int i = 0; i < userInput->stageCount; i++)
+	{
+		char** argv = userInput->stages[i].argv;
+		size_t size = environmentSize + sizeof(char*);
+		for (int j = 0; argv[j] != NULL; j++)
+		{
+			size_t length = strlen(argv[j]) + 1;
+			if (length > stringMax) {
+				printf("Argument %d of %s is too long: %zu bytes, limit is %zu!\n", j, argv[0], length, stringMax);
+				fflush(stdout);
+				return -1;
+			}
+			size += length + sizeof(char*);
+		}
+		if (argMax > 0 && size > (size_t)argMax) {
+			printf("Argument list of %s is too long: %d arguments, %zu bytes with the environment, limit is %ld!\n", argv[0], userInput->stages[i].argc, size, argMax);
+			fflush(stdout);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+// function to execute other commands
+int executeOtherCommands(struct parsedCommand* userInput, int current_status)
+{
+	// status to be returned from executing command
+	int status;
+
+	// argv that exec would refuse, tell the user instead of running half a command
+	if (checkArgumentSize(userInput) == -1) {
+		return 1;
+	}
+
+	// an @cpus= prefix places the command itself, otherwise background jobs go where set placement= puts them
+	struct placement placement;
+	struct placement* where = NULL;
+	if (userInput->cpus != NULL) {
+		placement.cpus = *userInput->cpus;
+		placement.node = -1;
+		where = &placement;
+	}
+	else if (userInput->background && !FOREGROUND_ONLY && PLACEMENT != PLACEMENT_NONE) {
+		choosePlacement(&placement);
+		where = &placement;
+	}
+
+	// run in background
+	if (userInput->background && !FOREGROUND_ONLY) {
+		// invoke runInBackground, a pipeline that could not start fails like one in the foreground
+		if (runInBackground(userInput->stages, userInput->stageCount, where) == -1) {
+			return 1;
+		}
+		// set status to current status since process running in background and return status
+		status = current_status;
+		return status;
+	}
+	// else, run in foreground and update status
+	status = runInForeground(userInput->stages, userInput->stageCount, where);
+	return status;
+}
+
+// function to keep the status of a background process that exited and announce it if the user started it, then drop it from the table.
+// newLine moves off the prompt line first. returns true if a message was printed
+bool finishJob(struct job* job, int childStatus, struct rusage* usage, bool newLine)
+{
+	bool reported = false;
+
+	// the status of a job is kept for wait, like the one of a foreground command, and goes in the stats
+	if (!job->silent) {
+		struct finishedJob* finished = &FINISHED_JOBS[FINISHED_COUNT++ % FINISHED_JOB_COUNT];
+		finished->pid = job->pid;
+		finished->number = job->number;
+		finished->status = convertStatus(childStatus, &finished->signalNumber);
+
+		struct timespec wall = elapsedSince(&job->started);
+		char name[64];
+		snprintf(name, sizeof(name), "%.*s", (int)strcspn(job->command, " "), job->command);
+		recordCommand(name, true, &wall, usage, finished->status, finished->signalNumber);
+	}
+
+	// inner pipeline stages and relays are reaped without a message
+	if (!job->silent) {
+		if (newLine) {
+			printf("\n");
+		}
+		printf("background pid %d is done: ", job->pid);
+		if (WIFEXITED(childStatus)) {  // normal exit, send status
+			printf("exit value %d", WEXITSTATUS(childStatus));
+		}
+		else { // abnormal exit send signal number
+			printf("terminated by signal %d", WTERMSIG(childStatus));
+		}
+
+		// a placed job also tells where it ran and for how long
+		if (job->cpus != NULL) {
+			char cpuList[256];
+			struct timespec elapsed = elapsedSince(&job->started);
+			formatCpuList(job->cpus, cpuList, sizeof(cpuList));
+			printf(" (ran on cpus %s for %.3f s)", cpuList, elapsed.tv_sec + elapsed.tv_nsec / 1e9);
+		}
+		printf("\n");
+		fflush(stdout);
+		reported = true;
+	}
+	removeJob(job->pid);
+	return reported;
+}
+
+// function to reap every finished background process in one batch, announcing the ones the user started. midPrompt moves off the prompt line first
+int reapJobs(bool midPrompt)
+{
+	// count of messages printed
+	int reported = 0;
+
+	// empty the signalfd, one read can hold many SIGCHLDs and several exits can share one
+	struct signalfd_siginfo signalInfo;
+	while (read(SIGCHLD_FD, &signalInfo, sizeof(signalInfo)) > 0);
+
+	// every foreground process is waited for before the shell gets here, so any child that changed state is a job
+	while (JOB_TABLE.count > 0)
+	{
+		// a job that was stopped or continued by a signal stays in the table, jobs shows which
+		siginfo_t childInfo;
+		childInfo.si_pid = 0;
+		if (waitid(P_ALL, 0, &childInfo, WSTOPPED | WCONTINUED | WNOHANG) == 0 && childInfo.si_pid != 0) {
+			struct job* job = findJob(childInfo.si_pid);
+			if (job != NULL) {
+				job->stopped = childInfo.si_code != CLD_CONTINUED;
+			}
+			continue;
+		}
+
+		// exits, wait4 also hands back what the process used
+		int childStatus;
+		struct rusage usage;
+		pid_t pid = wait4(-1, &childStatus, WNOHANG, &usage);
+		if (pid <= 0) {
+			break;
+		}
+
+		// not a job, nothing to report
+		struct job* job = findJob(pid);
+		if (job == NULL) {
+			continue;
+		}
+
+		if (finishJob(job, childStatus, &usage, midPrompt && reported == 0)) {
+			reported++;
+		}
+	}
+	return reported;
+}
+
+// function to reap the background processes that exited, each one by its pid, for when the shell has children that are not jobs
+// and that someone else waits for. stops and continues are left to reapJobs. returns the count of messages printed
+int reapJobTable(void)
+{
+	int reported = 0;
+	for (int i = 0; i < JOB_TABLE.capacity; i++)
+	{
+		int childStatus;
+		struct rusage usage;
+		struct job* job = &JOB_TABLE.jobs[i];
+		if (job->pid != 0 && wait4(job->pid, &childStatus, WNOHANG, &usage) == job->pid && finishJob(job, childStatus, &usage, false)) {
+			reported++;
+		}
+	}
+	return reported;
+}
+
+// function to set up a reader on an fd, interactive readers also watch for finished jobs while they wait
+void readerFromFD(struct lineReader* reader, int fd, bool interactive)
+{
+	reader->fd = fd;
+	reader->interactive = interactive;
+
+	// a terminal sends a line at a time, batch input is read in big chunks
+	reader->capacity = interactive ? 4096 : BATCH_BUFFER_SIZE;
+	reader->buffer = malloc(reader->capacity);
+	reader->start = 0;
+	reader->end = 0;
+	reader->eof = false;
+	reader->mapped = false;
+}
+
+// function to set up a reader on a string, like the command given with -c
+void readerFromString(struct lineReader* reader, char* commands)
+{
+	reader->fd = -1;
+	reader->interactive = false;
+	reader->buffer = commands;
+	reader->capacity = strlen(commands);
+	reader->start = 0;
+	reader->end = reader->capacity;
+	reader->eof = true;
+	reader->mapped = false;
+}
+
+// function to set up a reader on a script file, the whole file is mapped so it is never copied into a read buffer. returns -1 if it cannot be opened
+int readerFromFile(struct lineReader* reader, char* path)
+{
+	int scriptFD = open(path, O_RDONLY | O_CLOEXEC);
+	struct stat scriptStat;
+	if (scriptFD == -1 || fstat(scriptFD, &scriptStat) == -1) {
+		return -1;
+	}
+
+	// an empty file cannot be mapped, it is simply no input
+	readerFromString(reader, "");
+	if (scriptStat.st_size > 0) {
+		char* script = mmap(NULL, scriptStat.st_size, PROT_READ, MAP_PRIVATE, scriptFD, 0);
+		if (script == MAP_FAILED) {
+			close(scriptFD);
+			return -1;
+		}
+
+		// the script is read front to back once
+		madvise(script, scriptStat.st_size, MADV_SEQUENTIAL);
+		reader->buffer = script;
+		reader->capacity = scriptStat.st_size;
+		reader->end = scriptStat.st_size;
+		reader->mapped = true;
+	}
+	close(scriptFD);
+	return 0;
+}
+
+// function to read one whole command line into *line, like getline. the buffer grows to fit, returns the length, 0 if interrupted and -1 at end of input
+ssize_t readCommandLine(struct lineReader* reader, char** line, size_t* capacity)
+{
+	// the caller always gets a buffer back, even at end of input
+	if (*line == NULL || *capacity == 0) {
+		*capacity = 256;
+		*line = realloc(*line, *capacity);
+	}
+
+	size_t len = 0;
+	while (true)
+	{
+		// copy buffered input up to and including the new line
+		if (reader->start < reader->end)
+		{
+			size_t available = reader->end - reader->start;
+			char* newLine = memchr(reader->buffer + reader->start, '\n', available);
+			size_t count = newLine != NULL ? (size_t)(newLine - (reader->buffer + reader->start)) + 1 : available;
+
+			// double the line until the chunk and the terminator fit
+			while (len + count + 1 > *capacity) {
+				*capacity *= 2;
+				*line = realloc(*line, *capacity);
+			}
+			memcpy(*line + len, reader->buffer + reader->start, count);
+			reader->start += count;
+			len += count;
+			if (newLine != NULL) {
+				(*line)[len] = '\0';
+				return len;
+			}
+		}
+
+		// last line without a new line
+		if (reader->eof && len > 0) {
+			(*line)[len] = '\0';
+			return len;
+		}
+		if (reader->eof) {
+			return -1;
+		}
+
+		// wait until there is more input or a background process finishes, batch input just blocks in read
+		if (reader->interactive)
+		{
+			struct pollfd waitFDs[2] = { { reader->fd, POLLIN, 0 }, { SIGCHLD_FD, POLLIN, 0 } };
+			if (poll(waitFDs, 2, -1) == -1) {
+				// ^Z handler ran, hand back an empty line so the user is prompted again
+				if (errno == EINTR && len == 0) {
+					(*line)[0] = '\0';
+					return 0;
+				}
+				continue;
+			}
+
+			// announce finished jobs right away, then show the prompt again
+			if ((waitFDs[1].revents & POLLIN) && reapJobs(true) > 0) {
+				printf("%s", PROMPT);
+				fflush(stdout);
+			}
+			if (!(waitFDs[0].revents & (POLLIN | POLLHUP))) {
+				continue;
+			}
+		}
+
+		// read more input
+		ssize_t count = read(reader->fd, reader->buffer, reader->capacity);
+		if (count == 0) {
+			reader->eof = true;
+		}
+		else if (count > 0) {
+			reader->start = 0;
+			reader->end = count;
+		}
+		// ^Z handler interrupted an interactive read, reprompt
+		else if (errno == EINTR && reader->interactive && len == 0) {
+			(*line)[0] = '\0';
+			return 0;
+		}
+	}
+}
+
+// function to fork a shell that runs a command list of the parallel builtin with stdin on inFD and stdout and stderr on outFD, -1 if it cannot start
+pid_t startParallelList(struct commandNode* list, struct arena* arena, int inFD, int outFD)
+{
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		dup2(inFD, STDIN_FILENO);
+		dup2(outFD, STDOUT_FILENO);
+		dup2(outFD, STDERR_FILENO);
+		struct lineReader input = { -1, NULL, 0, 0, 0, true, false, false };
+		struct shellState shell = { LAST_STATUS, arena, &input, false, false };
+		list->background = false;
+		int status = runCommandList(list, &shell);
+		fflush(stdout);
+		exit(status == -1 ? 1 : status);
+	}
+	if (pid == -1) {
+		perror("parallel");
+		fflush(stdout);
+	}
+	return pid;
+}
+
+// function to start one command of the parallel builtin with stdout and stderr on a pipe, returns false if it could not start.
+// a plain pipeline is started by the builtin itself, a list with ; && || or a loop gets a fork of the shell that is the one stage of the job
+bool startParallelJob(struct parallelJob* job, struct arena* arena)
+{
+	// commands are parsed right before they start, argv is not needed once the processes exist
+	arenaReset(arena);
+	char* error;
+	struct commandNode* list = parseCommandList(arena, job->command, &error, NULL);
+	struct parsedCommand* parsed = NULL;
+	if (error == NULL && list != NULL && list->type == NODE_COMMAND && !list->background) {
+		parsed = parseCommandLine(arena, list->text);
+		error = parsed->error;
+	}
+	if (error != NULL || list == NULL || (parsed != NULL && parsed->stageCount == 0)) {
+		printf("parallel: %s: %s\n", job->command, error != NULL ? error : "Missing command in command line!");
+		fflush(stdout);
+		return false;
+	}
+
+	// output of every stage goes to one pipe that the builtin drains, stdin is /dev/null so jobs do not eat the command list
+	int outputPipe[2];
+	int nullFD = open("/dev/null", O_RDONLY | O_CLOEXEC);
+	if (nullFD == -1 || pipe2(outputPipe, O_CLOEXEC) == -1) {
+		perror("parallel");
+		if (nullFD != -1) {
+			close(nullFD);
+		}
+		return false;
+	}
+
+	// only the builtin's end does not block, a job writing faster than it is drained has to wait rather than get EAGAIN
+	fcntl(outputPipe[0], F_SETFL, O_NONBLOCK);
+
+	// pids and status of every stage, the pids of fan-out relays come after the stages
+	job->stageCount = parsed != NULL ? parsed->stageCount : 1;
+	job->pids = malloc(2 * job->stageCount * sizeof(pid_t));
+	job->stageStatus = malloc(job->stageCount * sizeof(int));
+	job->stageSignal = malloc(job->stageCount * sizeof(int));
+
+	// the shell of a list has its own copies of the fds once it is forked
+	if (parsed == NULL) {
+		job->pids[0] = startParallelList(list, arena, nullFD, outputPipe[1]);
+		job->pids[1] = -1;
+		close(nullFD);
+		close(outputPipe[1]);
+	}
+	// launchPipeline closes the /dev/null fd and the write end of the pipe once the stages have them
+	else if (launchPipeline(parsed->stages, parsed->stageCount, nullFD, outputPipe[1], outputPipe[1], false, job->pids, job->pids + job->stageCount, NULL) == -1) {
+		close(outputPipe[0]);
+		free(job->pids);
+		free(job->stageStatus);
+		free(job->stageSignal);
+		job->pids = NULL;
+		job->stageStatus = NULL;
+		job->stageSignal = NULL;
+		return false;
+	}
+	job->outputFD = outputPipe[0];
+	job->running = 0;
+	for (int i = 0; i < 2 * job->stageCount; i++)
+	{
+		// stage that never started failed like a command that cannot be executed
+		if (job->pids[i] == -1 && i < job->stageCount) {
+			job->stageStatus[i] = 1;
+			job->stageSignal[i] = 0;
+		}
+		else if (job->pids[i] != -1) {
+			job->running++;
+		}
+	}
+	return true;
+}
+
+// function to read whatever a parallel job has written so far, the output fd is closed at end of file
+void drainParallelJob(struct parallelJob* job)
+{
+	while (job->outputFD != -1)
+	{
+		// double the buffer when it is full
+		if (job->outputLength == job->outputCapacity) {
+			job->outputCapacity = job->outputCapacity ? job->outputCapacity * 2 : 4096;
+			job->output = realloc(job->output, job->outputCapacity);
+		}
+
+		ssize_t count = read(job->outputFD, job->output + job->outputLength, job->outputCapacity - job->outputLength);
+		if (count > 0) {
+			job->outputLength += count;
+		}
+		else if (count == 0 || errno != EINTR) {
+			// end of file, every stage closed its end. a nonblocking pipe with nothing in it stops here too
+			if (count == 0) {
+				close(job->outputFD);
+				job->outputFD = -1;
+			}
+			return;
+		}
+	}
+}
+
+// function to reap the stages and fan-out relays of a parallel job that have exited, no blocking
+void reapParallelJob(struct parallelJob* job)
+{
+	for (int i = 0; i < 2 * job->stageCount && job->running > 0; i++)
+	{
+		int childStatus;
+		if (job->pids[i] != -1 && waitpid(job->pids[i], &childStatus, WNOHANG) == job->pids[i]) {
+			// a relay's status is not part of the job
+			if (i < job->stageCount) {
+				job->stageStatus[i] = convertStatus(childStatus, &job->stageSignal[i]);
+			}
+			job->pids[i] = -1;
+			job->running--;
+		}
+	}
+}
+
+// function to print the captured output of a parallel job and free it
+void printParallelJob(struct parallelJob* job)
+{
+	fflush(stdout);
+	for (size_t written = 0; written < job->outputLength; )
+	{
+		ssize_t count = write(STDOUT_FILENO, job->output + written, job->outputLength - written);
+		if (count == -1 && errno != EINTR) {
+			break;
+		}
+		written += count > 0 ? count : 0;
+	}
+	free(job->output);
+	job->output = NULL;
+	job->printed = true;
+}
+
+// function for parallel command, runs commands with at most -j of them at once. commands are arguments, lines of -f file or lines of stdin
+int parallelCommand(char* argv[], struct shellState* shell)
+{
+	// default is one job per online cpu
+	long maxJobs = sysconf(_SC_NPROCESSORS_ONLN);
+	bool keepOrder = false;
+	char* commandFile = NULL;
+
+	// options come before the commands
+	int i = 1;
+	for (; argv[i] != NULL && argv[i][0] == '-'; i++)
+	{
+		if (strcmp(argv[i], "-k") == 0) {
+			keepOrder = true;
+		}
+		else if (strcmp(argv[i], "-j") == 0 && argv[i + 1] != NULL && atoi(argv[i + 1]) > 0) {
+			maxJobs = atoi(argv[++i]);
+		}
+		else if (strncmp(argv[i], "-j", 2) == 0 && atoi(argv[i] + 2) > 0) {
+			maxJobs = atoi(argv[i] + 2);
+		}
+		else if (strcmp(argv[i], "-f") == 0 && argv[i + 1] != NULL) {
+			commandFile = argv[++i];
+		}
+		else if (strcmp(argv[i], "--") == 0) {
+			i++;
+			break;
+		}
+		else {
+			printf("usage: parallel [-j jobs] [-k] [-f file | command...]\n");
+			fflush(stdout);
+			return 1;
+		}
+	}
+
+	// commands given as arguments are used as they are, a file or stdin is read one command per line
+	int commandCount = 0;
+	char** commands = NULL;
+	if (argv[i] != NULL) {
+		commands = &argv[i];
+		while (commands[commandCount] != NULL) {
+			commandCount++;
+		}
+	}
+	else {
+		// a file gets its own reader, stdin shares the reader of the shell so nothing it buffered is lost
+		struct lineReader fileReader;
+		struct lineReader* reader = shell->input;
+		if (commandFile != NULL) {
+			if (readerFromFile(&fileReader, commandFile) == -1) {
+				perror(commandFile);
+				return 1;
+			}
+			reader = &fileReader;
+		}
+		// stdin from a < file, or input the shell does not read, gets a reader of its own. so does a terminal, end of file there only ends the list
+		else if (shell->inputRedirected || shell->input->fd != STDIN_FILENO || shell->input->interactive) {
+			readerFromFD(&fileReader, STDIN_FILENO, false);
+			reader = &fileReader;
+		}
+
+		// read commands until end of input, skipping blank lines and comments
+		char* line = NULL;
+		size_t lineCapacity = 0;
+		ssize_t len;
+		int capacity = 0;
+		while ((len = readCommandLine(reader, &line, &lineCapacity)) != -1)
+		{
+			if (len > 0 && line[len - 1] == '\n') {
+				line[--len] = '\0';
+			}
+			if (len == 0 || line[0] == '#') {
+				continue;
+			}
+			if (commandCount == capacity) {
+				capacity = capacity * 2 + 16;
+				commands = realloc(commands, capacity * sizeof(char*));
+			}
+			commands[commandCount++] = strdup(line);
+		}
+		free(line);
+
+		// give back the reader of a file
+		if (reader == &fileReader) {
+			if (fileReader.mapped) {
+				munmap(fileReader.buffer, fileReader.capacity);
+			}
+			else if (fileReader.fd != -1) {
+				free(fileReader.buffer);
+			}
+		}
+	}
+
+	// one entry per command, and an arena to parse them in
+	struct parallelJob* jobs = calloc(commandCount > 0 ? commandCount : 1, sizeof(struct parallelJob));
+	struct arena arena = {0};
+	for (int j = 0; j < commandCount; j++)
+	{
+		jobs[j].command = commands[j];
+		jobs[j].outputFD = -1;
+	}
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	// next command to start, next one to print with -k, jobs that failed and jobs that are done
+	int nextJob = 0, nextPrint = 0, failed = 0, finished = 0;
+
+	// jobs in flight, and what poll waits on: their output pipes and the signalfd
+	int activeCount = 0;
+	struct parallelJob** active = malloc(maxJobs * sizeof(struct parallelJob*));
+	struct pollfd* waitFDs = malloc((maxJobs + 1) * sizeof(struct pollfd));
+	struct parallelJob** waitJobs = malloc(maxJobs * sizeof(struct parallelJob*));
+	while (true)
+	{
+		// fill every free slot right away
+		while (activeCount < maxJobs && nextJob < commandCount)
+		{
+			struct parallelJob* job = &jobs[nextJob++];
+			if (startParallelJob(job, &arena)) {
+				active[activeCount++] = job;
+			}
+			else {
+				job->status = 1;
+				job->done = true;
+				failed++;
+				finished++;
+			}
+		}
+
+		// with -k output is printed in command order, as soon as every command before it is done
+		while (keepOrder && nextPrint < commandCount && jobs[nextPrint].done)
+		{
+			printParallelJob(&jobs[nextPrint++]);
+		}
+		if (finished == commandCount) {
+			break;
+		}
+
+		// wait for output or a child exit, SIGCHLD comes in through the signalfd
+		int waitCount = 0;
+		for (int j = 0; j < activeCount; j++)
+		{
+			if (active[j]->outputFD != -1) {
+				waitFDs[waitCount].fd = active[j]->outputFD;
+				waitFDs[waitCount].events = POLLIN;
+				waitJobs[waitCount++] = active[j];
+			}
+		}
+		waitFDs[waitCount].fd = SIGCHLD_FD;
+		waitFDs[waitCount].events = POLLIN;
+		if (poll(waitFDs, waitCount + 1, -1) == -1) {
+			continue;
+		}
+
+		// take in output
+		for (int j = 0; j < waitCount; j++)
+		{
+			if (waitFDs[j].revents) {
+				drainParallelJob(waitJobs[j]);
+			}
+		}
+
+		// empty the signalfd, then reap jobs whose processes exited. background jobs of the shell that exited meanwhile are
+		// reaped by their pids too, wait4 on any child would take the builtin's own processes
+		if (waitFDs[waitCount].revents & POLLIN) {
+			struct signalfd_siginfo signalInfo;
+			while (read(SIGCHLD_FD, &signalInfo, sizeof(signalInfo)) > 0);
+			reapJobTable();
+		}
+		for (int j = 0; j < activeCount; j++)
+		{
+			struct parallelJob* job = active[j];
+			reapParallelJob(job);
+
+			// a job is done once every stage exited and all of its output is in
+			if (job->running == 0 && job->outputFD == -1) {
+				job->status = pipelineStatus(job->stageStatus, job->stageSignal, job->stageCount, &job->signalNumber);
+				job->done = true;
+				finished++;
+				if (job->status != 0) {
+					failed++;
+				}
+
+				// without -k output is printed as soon as the job is done
+				if (!keepOrder) {
+					printParallelJob(job);
+				}
+
+				// free the slot, the last job in flight takes its place
+				active[j--] = active[--activeCount];
+			}
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	// summary with every command that failed
+	for (int j = 0; j < commandCount; j++)
+	{
+		if (jobs[j].signalNumber != 0) {
+			printf("parallel: failed: %s (terminated by signal %d)\n", jobs[j].command, jobs[j].signalNumber);
+		}
+		else if (jobs[j].status != 0) {
+			printf("parallel: failed: %s\n", jobs[j].command);
+		}
+	}
+	double wall = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("parallel: %d jobs, %d failed, %ld at once, %.3f s wall\n", commandCount, failed, maxJobs, wall);
+	fflush(stdout);
+
+	// free everything, commands read from a file or stdin were copied
+	for (int j = 0; j < commandCount; j++)
+	{
+		free(jobs[j].pids);
+		free(jobs[j].stageStatus);
+		free(jobs[j].stageSignal);
+		free(jobs[j].output);
+		if (argv[i] == NULL) {
+			free(commands[j]);
+		}
+	}
+	if (argv[i] == NULL) {
+		free(commands);
+	}
+	free(jobs);
+	free(active);
+	free(waitFDs);
+	free(waitJobs);
+	arenaRelease(&arena);
+	return failed > 0 ? 1 : 0;
+}
+
+// function to open the history file, $HISTFILE or ~/.smallsh_history. an empty HISTFILE turns history off
+void openHistory(void)
+{
+	char* path = getenv("HISTFILE");
+	char defaultPath[4096];
+	if (path == NULL) {
+		char* home = getenv("HOME");
+		if (home == NULL) {
+			return;
+		}
+		snprintf(defaultPath, sizeof(defaultPath), "%s/.smallsh_history", home);
+		path = defaultPath;
+	}
+	if (*path == '\0') {
+		return;
+	}
+
+	// O_APPEND puts every record at the end of the file in one write, whatever other shells append meanwhile
+	HISTORY.fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+}
+
+// function to forget every entry and both indexes, used when the history file got shorter under us
+void resetHistory(void)
+{
+	for (unsigned int i = 0; i < HISTORY.postingSlots; i++)
+	{
+		free(HISTORY.postings[i].ids);
+	}
+	free(HISTORY.postings);
+	HISTORY.postings = NULL;
+	HISTORY.postingSlots = 0;
+	HISTORY.postingsUsed = 0;
+	HISTORY.trigramIndexed = 0;
+	HISTORY.count = 0;
+	HISTORY.indexedBytes = 0;
+}
+
+// function to map whatever was appended to the history file since the last look and add its records to the entries, returns -1 if there is no history
+int syncHistory(void)
+{
+	struct stat historyStat;
+	if (HISTORY.fd == -1 || fstat(HISTORY.fd, &historyStat) == -1) {
+		return -1;
+	}
+	size_t size = historyStat.st_size;
+	if (size < HISTORY.indexedBytes) {
+		resetHistory();
+	}
+
+	// map the file again when it grew, entries are offsets so they stay good
+	if (size != HISTORY.mapSize)
+	{
+		if (HISTORY.map != NULL) {
+			munmap(HISTORY.map, HISTORY.mapSize);
+		}
+		HISTORY.map = NULL;
+		HISTORY.mapSize = 0;
+		if (size > 0) {
+			char* map = mmap(NULL, size, PROT_READ, MAP_SHARED, HISTORY.fd, 0);
+			if (map == MAP_FAILED) {
+				return -1;
+			}
+			madvise(map, size, MADV_SEQUENTIAL);
+			HISTORY.map = map;
+			HISTORY.mapSize = size;
+		}
+	}
+
+	// records are "seconds<tab>command<new line>", a line without the time is taken as a command as it is
+	char* next = HISTORY.map + HISTORY.indexedBytes;
+	char* end = HISTORY.map + HISTORY.mapSize;
+	char* newLine;
+	while (next < end && (newLine = memchr(next, '\n', end - next)) != NULL)
+	{
+		char* command = next;
+		char* digit = next;
+		while (digit < newLine && isdigit((unsigned char)*digit)) {
+			digit++;
+		}
+		if (digit > next && digit < newLine && *digit == '\t') {
+			command = digit + 1;
+		}
+
+		// empty commands are not entries
+		if (command < newLine)
+		{
+			if (HISTORY.count == HISTORY.capacity) {
+				HISTORY.capacity = HISTORY.capacity ? HISTORY.capacity * 2 : 1024;
+				HISTORY.entries = realloc(HISTORY.entries, HISTORY.capacity * sizeof(struct historyEntry));
+			}
+			HISTORY.entries[HISTORY.count].start = command - HISTORY.map;
+			HISTORY.entries[HISTORY.count].length = newLine - command;
+			HISTORY.count++;
+		}
+		next = newLine + 1;
+	}
+	HISTORY.indexedBytes = next - HISTORY.map;
+	return 0;
+}
+
+// function to add a command to the history file, one write per record so records of concurrent shells never mix
+void addHistory(const char* command)
+{
+	if (HISTORY.fd == -1) {
+		return;
+	}
+	size_t length = strlen(command);
+	char* record = malloc(length + 32);
+	int prefix = sprintf(record, "%ld\t", (long)time(NULL));
+	memcpy(record + prefix, command, length);
+	record[prefix + length] = '\n';
+	write(HISTORY.fd, record, prefix + length + 1);
+	free(record);
+}
+
+// function to get the text of entry id, it is not NUL terminated
+const char* historyText(unsigned int id, unsigned int* length)
+{
+	*length = HISTORY.entries[id].length;
+	return HISTORY.map + HISTORY.entries[id].start;
+}
+
+// function to find the posting list of a trigram, add creates an empty one if there is none. NULL if there is none
+struct trigramPosting* findTrigram(unsigned int trigram, bool add)
+{
+	// keep the table at most half full, the slot count is a power of two
+	if (add && (HISTORY.postingsUsed + 1) * 2 > HISTORY.postingSlots)
+	{
+		unsigned int oldSlots = HISTORY.postingSlots;
+		struct trigramPosting* old = HISTORY.postings;
+		HISTORY.postingSlots = oldSlots ? oldSlots * 2 : 4096;
+		HISTORY.postings = calloc(HISTORY.postingSlots, sizeof(struct trigramPosting));
+		for (unsigned int i = 0; i < oldSlots; i++)
+		{
+			if (old[i].ids != NULL) {
+				unsigned int slot = (old[i].trigram * 2654435761u) & (HISTORY.postingSlots - 1);
+				while (HISTORY.postings[slot].ids != NULL) {
+					slot = (slot + 1) & (HISTORY.postingSlots - 1);
+				}
+				HISTORY.postings[slot] = old[i];
+			}
+		}
+		free(old);
+	}
+	if (HISTORY.postingSlots == 0) {
+		return NULL;
+	}
+
+	// linear probing from the hashed slot, an empty slot ends the search
+	unsigned int slot = (trigram * 2654435761u) & (HISTORY.postingSlots - 1);
+	while (HISTORY.postings[slot].ids != NULL)
+	{
+		if (HISTORY.postings[slot].trigram == trigram) {
+			return &HISTORY.postings[slot];
+		}
+		slot = (slot + 1) & (HISTORY.postingSlots - 1);
+	}
+	if (!add) {
+		return NULL;
+	}
+	HISTORY.postings[slot].trigram = trigram;
+	HISTORY.postings[slot].capacity = 4;
+	HISTORY.postings[slot].ids = malloc(4 * sizeof(unsigned int));
+	HISTORY.postingsUsed++;
+	return &HISTORY.postings[slot];
+}
+
+// function to add the entries that came in since the last search to the trigram index
+void indexTrigrams(void)
+{
+	for (; HISTORY.trigramIndexed < HISTORY.count; HISTORY.trigramIndexed++)
+	{
+		unsigned int id = HISTORY.trigramIndexed, length;
+		const unsigned char* text = (const unsigned char*)historyText(id, &length);
+		for (unsigned int i = 0; i + 2 < length; i++)
+		{
+			struct trigramPosting* posting = findTrigram(text[i] << 16 | text[i + 1] << 8 | text[i + 2], true);
+
+			// an entry is listed once however often it has the trigram
+			if (posting->count > 0 && posting->ids[posting->count - 1] == id) {
+				continue;
+			}
+			if (posting->count == posting->capacity) {
+				posting->capacity *= 2;
+				posting->ids = realloc(posting->ids, posting->capacity * sizeof(unsigned int));
+			}
+			posting->ids[posting->count++] = id;
+		}
+	}
+}
+
+// function to find the entries that contain pattern, in order. the trigram of the pattern with the fewest entries gives the candidates,
+// each is checked with memmem. returns the number of matches, ids is malloc'd
+unsigned int searchHistory(const char* pattern, unsigned int** ids)
+{
+	size_t patternLength = strlen(pattern);
+	unsigned int* candidates = NULL;
+	unsigned int candidateCount = HISTORY.count;
+
+	// patterns shorter than a trigram check every entry
+	if (patternLength >= 3)
+	{
+		indexTrigrams();
+		const unsigned char* p = (const unsigned char*)pattern;
+		for (size_t i = 0; i + 2 < patternLength; i++)
+		{
+			struct trigramPosting* posting = findTrigram(p[i] << 16 | p[i + 1] << 8 | p[i + 2], false);
+			if (posting == NULL) {
+				*ids = NULL;
+				return 0;
+			}
+			if (candidates == NULL || posting->count < candidateCount) {
+				candidates = posting->ids;
+				candidateCount = posting->count;
+			}
+		}
+	}
+
+	unsigned int matches = 0;
+	*ids = malloc((candidateCount ? candidateCount : 1) * sizeof(unsigned int));
+	for (unsigned int i = 0; i < candidateCount; i++)
+	{
+		unsigned int id = candidates != NULL ? candidates[i] : i, length;
+		const char* text = historyText(id, &length);
+		if (memmem(text, length, pattern, patternLength) != NULL) {
+			(*ids)[matches++] = id;
+		}
+	}
+	return matches;
+}
+
+// function to find the newest entry that starts with prefix, !! is the last entry. -1 if there is none
+int recallHistory(const char* prefix)
+{
+	if (syncHistory() == -1) {
+		return -1;
+	}
+	if (strcmp(prefix, "!") == 0) {
+		return (int)HISTORY.count - 1;
+	}
+
+	// !number is the entry with that number in the history list
+	if (strspn(prefix, "0123456789") == strlen(prefix)) {
+		long number = atol(prefix);
+		return (number >= 1 && number <= (long)HISTORY.count) ? (int)number - 1 : -1;
+	}
+	size_t prefixLength = strlen(prefix);
+	for (int id = (int)HISTORY.count - 1; id >= 0; id--)
+	{
+		unsigned int length;
+		const char* text = historyText(id, &length);
+		if (length >= prefixLength && memcmp(text, prefix, prefixLength) == 0) {
+			return id;
+		}
+	}
+	return -1;
+}
+
+// function for history command, lists the last count entries or the ones that contain pattern: history [-n count] [pattern]
+int historyCommand(char* argv[], struct shellState* shell)
+{
+	long limit = -1;
+	int i = 1;
+	if (argv[i] != NULL && strcmp(argv[i], "-n") == 0 && argv[i + 1] != NULL) {
+		limit = atol(argv[i + 1]);
+		i += 2;
+	}
+	if (argv[i] != NULL && argv[i + 1] != NULL) {
+		printf("usage: history [-n count] [pattern]\n");
+		fflush(stdout);
+		return 1;
+	}
+	if (syncHistory() == -1) {
+		printf("history: no history file\n");
+		fflush(stdout);
+		return 1;
+	}
+
+	// every entry, or the ones with the pattern
+	unsigned int* ids = NULL;
+	unsigned int matches = HISTORY.count;
+	if (argv[i] != NULL) {
+		matches = searchHistory(argv[i], &ids);
+	}
+
+	// only the newest ones when there is a limit, numbers are the ones ! would use
+	unsigned int first = (limit >= 0 && (unsigned long)limit < matches) ? matches - limit : 0;
+	for (unsigned int j = first; j < matches; j++)
+	{
+		unsigned int id = ids != NULL ? ids[j] : j, length;
+		const char* text = historyText(id, &length);
+		printf("%6u  %.*s\n", id + 1, (int)length, text);
+	}
+	fflush(stdout);
+	free(ids);
+	return 0;
+}
+
+// function for exit command, the prompt loop ends after it
+int exitShell(char* argv[], struct shellState* shell)
+{
+	shell->exiting = true;
+	return shell->status;
+}
+
+// function for break and continue commands, leave the innermost count loops. continue goes on with the next round of the last one: break [count]
+int breakLoop(char* argv[], struct shellState* shell)
+{
+	int count = argv[1] != NULL ? atoi(argv[1]) : 1;
+	if (count < 1 || (argv[1] != NULL && argv[2] != NULL)) {
+		printf("usage: %s [count]\n", argv[0]);
+		fflush(stdout);
+		return 1;
+	}
+	if (shell->loopDepth == 0) {
+		printf("%s: only meaningful in a loop\n", argv[0]);
+		fflush(stdout);
+		return 1;
+	}
+	shell->jump = strcmp(argv[0], "break") == 0 ? JUMP_BREAK : JUMP_CONTINUE;
+	shell->jumpLevels = count < shell->loopDepth ? count : shell->loopDepth;
+	return 0;
+}
+
+// function for return command, leaves the function with status or the status of the last command: return [status]
+int returnCommand(char* argv[], struct shellState* shell)
+{
+	if (shell->functionDepth == 0) {
+		printf("return: only meaningful in a function\n");
+		fflush(stdout);
+		return 1;
+	}
+	shell->jump = JUMP_RETURN;
+	return argv[1] != NULL ? atoi(argv[1]) : shell->status;
+}
+
+// function to run a shell function, its body runs in this shell with the arguments as $1 and up while the ones of the caller are kept
+int callFunction(char* argv[], struct shellState* shell)
+{
+	if (shell->functionDepth == FUNCTION_DEPTH_LIMIT) {
+		printf("%s: functions nested too deep\n", argv[0]);
+		fflush(stdout);
+		return 1;
+	}
+	struct shellFunction* function = findFunction(argv[0]);
+	char** callerArgs = POSITIONAL_ARGS;
+	int callerCount = POSITIONAL_COUNT;
+	POSITIONAL_ARGS = argv + 1;
+	for (POSITIONAL_COUNT = 0; argv[POSITIONAL_COUNT + 1] != NULL; POSITIONAL_COUNT++);
+
+	shell->functionDepth++;
+	int status = runCommandList(function->body, shell);
+	shell->functionDepth--;
+	POSITIONAL_ARGS = callerArgs;
+	POSITIONAL_COUNT = callerCount;
+
+	// return ends here, a command that could not run only fails the call
+	if (shell->jump == JUMP_RETURN) {
+		shell->jump = JUMP_NONE;
+	}
+	return status == -1 ? 1 : status;
+}
+
+// function to print the backslash escape that s points at, like echo -e and printf. zeroOctal is the \0nnn form of echo.
+// returns the last character of the escape, stop is set at \c which ends all output
+const char* printEscape(const char* s, bool zeroOctal, bool* stop)
+{
+	// characters of the simple escapes and what they stand for
+	static const char escapes[] = "abefnrtv\\";
+	static const char values[] = "\a\b\033\f\n\r\t\v\\";
+
+	char* simple = strchr(escapes, s[1]);
+	if (s[1] != '\0' && simple != NULL) {
+		putchar(values[simple - escapes]);
+		return s + 1;
+	}
+	if (s[1] == 'c') {
+		*stop = true;
+		return s + 1;
+	}
+	if (s[1] == '"' && !zeroOctal) {
+		putchar('"');
+		return s + 1;
+	}
+
+	// \xHH, one or two hex digits
+	if (s[1] == 'x' && isxdigit((unsigned char)s[2])) {
+		int value = 0, digits = 0;
+		for (s += 2; digits < 2 && isxdigit((unsigned char)*s); s++, digits++) {
+			value = value * 16 + (isdigit((unsigned char)*s) ? *s - '0' : tolower((unsigned char)*s) - 'a' + 10);
+		}
+		putchar(value);
+		return s - 1;
+	}
+
+	// octal, up to three digits after the 0 for echo and up to three digits for printf
+	if ((zeroOctal && s[1] == '0') || (!zeroOctal && s[1] >= '0' && s[1] <= '7')) {
+		int value = 0, digits = 0;
+		for (s += zeroOctal ? 2 : 1; digits < 3 && *s >= '0' && *s <= '7'; s++, digits++) {
+			value = value * 8 + (*s - '0');
+		}
+		putchar(value);
+		return s - 1;
+	}
+
+	// not an escape, the backslash stays
+	putchar('\\');
+	return s;
+}
+
+// function to print a string with its backslash escapes expanded, returns true at \c
+bool printEscapes(const char* s, bool zeroOctal)
+{
+	bool stop = false;
+	for (; *s && !stop; s++)
+	{
+		if (*s == '\\' && s[1] != '\0') {
+			s = printEscape(s, zeroOctal, &stop);
+		}
+		else {
+			putchar(*s);
+		}
+	}
+	return stop;
+}
+
+// function to flush what a builtin printed, a failed write fails the builtin like it fails the program
+int finishOutput(int status)
+{
+	if (fflush(stdout) == EOF || ferror(stdout)) {
+		clearerr(stdout);
+		return 1;
+	}
+	return status;
+}
+
+// function for echo command, the same options as /bin/echo: -n drops the new line, -e expands escapes and -E does not
+int echoCommand(char* argv[], struct shellState* shell)
+{
+	bool newLine = true, escapes = false;
+
+	// only words made of n, e and E are options, anything else is printed
+	int i = 1;
+	for (; argv[i] != NULL && argv[i][0] == '-' && argv[i][1] != '\0' && strspn(argv[i] + 1, "neE") == strlen(argv[i] + 1); i++)
+	{
+		for (char* option = argv[i] + 1; *option; option++)
+		{
+			if (*option == 'n') {
+				newLine = false;
+			}
+			else {
+				escapes = (*option == 'e');
+			}
+		}
+	}
+
+	// words are separated by one space, \c ends the output there
+	for (int first = i; argv[i] != NULL; i++)
+	{
+		if (i > first) {
+			putchar(' ');
+		}
+		if (!escapes) {
+			fputs(argv[i], stdout);
+		}
+		else if (printEscapes(argv[i], true)) {
+			return finishOutput(0);
+		}
+	}
+	if (newLine) {
+		putchar('\n');
+	}
+	return finishOutput(0);
+}
+
+// function for true command
+int trueCommand(char* argv[], struct shellState* shell)
+{
+	return 0;
+}
+
+// function for false command
+int falseCommand(char* argv[], struct shellState* shell)
+{
+	return 1;
+}
+
+// function to read a numeric printf argument, a leading quote gives the code of the next character. bad numbers set status to 1
+long double printfNumber(char* argument, bool isFloat, int* status)
+{
+	if (argument == NULL) {
+		return 0;
+	}
+	if (argument[0] == '\'' || argument[0] == '"') {
+		return (unsigned char)argument[1];
+	}
+
+	char* end;
+	errno = 0;
+	long double value = isFloat ? strtold(argument, &end) : (long double)strtoll(argument, &end, 0);
+	if (*argument == '\0' || *end != '\0' || errno == ERANGE) {
+		fprintf(stderr, "printf: '%s': expected a numeric value\n", argument);
+		*status = 1;
+	}
+	return value;
+}
+
+// function for printf command, the format is used again while arguments are left like printf(1)
+int printfCommand(char* argv[], struct shellState* shell)
+{
+	if (argv[1] == NULL) {
+		fprintf(stderr, "printf: missing operand\n");
+		return 1;
+	}
+	char* format = argv[1];
+	char** argument = &argv[2];
+	int status = 0;
+	bool stop = false;
+
+	do
+	{
+		// a format without conversions is printed once whatever the arguments
+		char** passStart = argument;
+		for (const char* c = format; *c && !stop; c++)
+		{
+			if (*c == '\\' && c[1] != '\0') {
+				c = printEscape(c, false, &stop);
+				continue;
+			}
+			if (*c != '%') {
+				putchar(*c);
+				continue;
+			}
+			if (c[1] == '%') {
+				putchar('%');
+				c++;
+				continue;
+			}
+
+			// copy flags, width and precision into a format of our own, the length modifier is added per conversion
+			char spec[64] = "%";
+			size_t specLength = 1;
+			for (c++; *c && strchr("-+ #0123456789.", *c) != NULL && specLength < sizeof(spec) - 4; c++) {
+				spec[specLength++] = *c;
+			}
+			char conversion = *c;
+			char* value = *argument;
+			if (value != NULL) {
+				argument++;
+			}
+
+			if (conversion == 's' || conversion == 'c') {
+				spec[specLength++] = conversion;
+				spec[specLength] = '\0';
+				if (conversion == 's') {
+					printf(spec, value != NULL ? value : "");
+				}
+				else {
+					printf(spec, value != NULL ? value[0] : '\0');
+				}
+			}
+			else if (conversion == 'b') {
+				stop = printEscapes(value != NULL ? value : "", true);
+			}
+			else if (conversion != '\0' && strchr("diouxX", conversion) != NULL) {
+				strcpy(spec + specLength, "ll");
+				spec[specLength + 2] = conversion;
+				spec[specLength + 3] = '\0';
+				printf(spec, (long long)printfNumber(value, false, &status));
+			}
+			else if (conversion != '\0' && strchr("feEgGaA", conversion) != NULL) {
+				spec[specLength++] = 'L';
+				spec[specLength++] = conversion;
+				spec[specLength] = '\0';
+				printf(spec, printfNumber(value, true, &status));
+			}
+			// unknown conversion or a % at the very end
+			else {
+				spec[specLength] = '\0';
+				fprintf(stderr, "printf: %s%.1s: invalid conversion specification\n", spec, c);
+				return finishOutput(1);
+			}
+		}
+
+		// nothing was used this time round, going again would print the same forever
+		if (argument == passStart) {
+			break;
+		}
+	} while (*argument != NULL && !stop);
+
+	return finishOutput(status);
+}
+
+/* State of the test expression parser, position is the next argument to read */
+struct testParser
+{
+	char** args;
+	int count;
+	int position;
+	bool error;
+};
+
+// function to read an integer operand of test
+long long testInteger(struct testParser* parser, char* operand)
+{
+	char* end;
+	errno = 0;
+	long long value = strtoll(operand, &end, 10);
+	while (*end == ' ' || *end == '\t') {
+		end++;
+	}
+	if (*operand == '\0' || *end != '\0' || errno == ERANGE) {
+		fprintf(stderr, "test: %s: integer expression expected\n", operand);
+		parser->error = true;
+	}
+	return value;
+}
+
+// function to tell if word is a binary operator of test
+bool testBinaryOperator(char* word)
+{
+	static char* operators[] = { "=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt", "-ge", "-nt", "-ot", "-ef", NULL };
+	for (int i = 0; operators[i] != NULL; i++)
+	{
+		if (strcmp(word, operators[i]) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// function to evaluate left operator right
+bool testBinary(struct testParser* parser, char* left, char* operator, char* right)
+{
+	if (strcmp(operator, "=") == 0 || strcmp(operator, "==") == 0) {
+		return strcmp(left, right) == 0;
+	}
+	if (strcmp(operator, "!=") == 0) {
+		return strcmp(left, right) != 0;
+	}
+	if (strcmp(operator, "<") == 0) {
+		return strcmp(left, right) < 0;
+	}
+	if (strcmp(operator, ">") == 0) {
+		return strcmp(left, right) > 0;
+	}
+
+	// file comparisons, a file that does not exist is older than any other
+	if (strcmp(operator, "-nt") == 0 || strcmp(operator, "-ot") == 0 || strcmp(operator, "-ef") == 0) {
+		struct stat leftStat, rightStat;
+		bool leftExists = stat(left, &leftStat) == 0, rightExists = stat(right, &rightStat) == 0;
+		if (strcmp(operator, "-ef") == 0) {
+			return leftExists && rightExists && leftStat.st_dev == rightStat.st_dev && leftStat.st_ino == rightStat.st_ino;
+		}
+		if (!leftExists || !rightExists) {
+			return strcmp(operator, "-nt") == 0 ? leftExists : rightExists;
+		}
+		long long difference = (long long)leftStat.st_mtim.tv_sec - rightStat.st_mtim.tv_sec;
+		if (difference == 0) {
+			difference = leftStat.st_mtim.tv_nsec - rightStat.st_mtim.tv_nsec;
+		}
+		return strcmp(operator, "-nt") == 0 ? difference > 0 : difference < 0;
+	}
+
+	// integer comparisons
+	long long a = testInteger(parser, left), b = testInteger(parser, right);
+	if (strcmp(operator, "-eq") == 0) {
+		return a == b;
+	}
+	if (strcmp(operator, "-ne") == 0) {
+		return a != b;
+	}
+	if (strcmp(operator, "-lt") == 0) {
+		return a < b;
+	}
+	if (strcmp(operator, "-le") == 0) {
+		return a <= b;
+	}
+	if (strcmp(operator, "-gt") == 0) {
+		return a > b;
+	}
+	return a >= b;
+}
+
+// function to evaluate a unary file or string test
+bool testUnary(struct testParser* parser, char operator, char* operand)
+{
+	struct stat fileStat;
+	switch (operator)
+	{
+		case 'n': return operand[0] != '\0';
+		case 'z': return operand[0] == '\0';
+		case 'r': return access(operand, R_OK) == 0;
+		case 'w': return access(operand, W_OK) == 0;
+		case 'x': return access(operand, X_OK) == 0;
+		case 't': return isatty(testInteger(parser, operand));
+		case 'L':
+		case 'h': return lstat(operand, &fileStat) == 0 && S_ISLNK(fileStat.st_mode);
+	}
+	if (stat(operand, &fileStat) != 0) {
+		return false;
+	}
+	switch (operator)
+	{
+		case 'e': return true;
+		case 'f': return S_ISREG(fileStat.st_mode);
+		case 'd': return S_ISDIR(fileStat.st_mode);
+		case 's': return fileStat.st_size > 0;
+		case 'b': return S_ISBLK(fileStat.st_mode);
+		case 'c': return S_ISCHR(fileStat.st_mode);
+		case 'p': return S_ISFIFO(fileStat.st_mode);
+		case 'S': return S_ISSOCK(fileStat.st_mode);
+		case 'u': return (fileStat.st_mode & S_ISUID) != 0;
+		case 'g': return (fileStat.st_mode & S_ISGID) != 0;
+		case 'k': return (fileStat.st_mode & S_ISVTX) != 0;
+	}
+	return false;
+}
+
+// ( expression ) in testPrimary starts over at -o, so it is used before it is defined
+bool testOr(struct testParser* parser);
+
+// function to evaluate ! expression, ( expression ), a binary or unary test or a lone string
+bool testPrimary(struct testParser* parser)
+{
+	if (parser->position >= parser->count) {
+		fprintf(stderr, "test: argument expected\n");
+		parser->error = true;
+		return false;
+	}
+	char** args = parser->args;
+	int left = parser->count - parser->position;
+	char* word = args[parser->position];
+
+	// a binary operator wins over everything else, so test ! = x compares strings
+	if (left >= 3 && testBinaryOperator(args[parser->position + 1])) {
+		parser->position += 3;
+		return testBinary(parser, word, args[parser->position - 2], args[parser->position - 1]);
+	}
+	if (strcmp(word, "!") == 0 && left >= 2) {
+		parser->position++;
+		return !testPrimary(parser);
+	}
+	if (strcmp(word, "(") == 0 && left >= 2) {
+		parser->position++;
+		bool result = testOr(parser);
+		if (parser->position >= parser->count || strcmp(args[parser->position], ")") != 0) {
+			fprintf(stderr, "test: ')' expected\n");
+			parser->error = true;
+			return false;
+		}
+		parser->position++;
+		return result;
+	}
+	if (word[0] == '-' && word[1] != '\0' && word[2] == '\0' && strchr("nzrwxtLhefdsbcpSugk", word[1]) != NULL && left >= 2) {
+		parser->position += 2;
+		return testUnary(parser, word[1], args[parser->position - 1]);
+	}
+
+	// a string alone is true when it is not empty
+	parser->position++;
+	return word[0] != '\0';
+}
+
+// function to evaluate expressions joined by -a
+bool testAnd(struct testParser* parser)
+{
+	bool result = testPrimary(parser);
+	while (parser->position < parser->count && strcmp(parser->args[parser->position], "-a") == 0)
+	{
+		parser->position++;
+		result = testPrimary(parser) && result;
+	}
+	return result;
+}
+
+// function to evaluate expressions joined by -o, -a binds tighter
+bool testOr(struct testParser* parser)
+{
+	bool result = testAnd(parser);
+	while (parser->position < parser->count && strcmp(parser->args[parser->position], "-o") == 0)
+	{
+		parser->position++;
+		result = testAnd(parser) || result;
+	}
+	return result;
+}
+
+// function for test and [ commands, 0 if the expression is true and 1 if it is false or wrong like test(1)
+int testCommand(char* argv[], struct shellState* shell)
+{
+	struct testParser parser = { argv + 1, 0, 0, false };
+	while (parser.args[parser.count] != NULL) {
+		parser.count++;
+	}
+
+	// [ needs its closing ]
+	if (strcmp(argv[0], "[") == 0) {
+		if (parser.count == 0 || strcmp(parser.args[parser.count - 1], "]") != 0) {
+			fprintf(stderr, "[: missing ']'\n");
+			return 1;
+		}
+		parser.count--;
+	}
+
+	// no expression is false
+	if (parser.count == 0) {
+		return 1;
+	}
+
+	bool result = testOr(&parser);
+	if (!parser.error && parser.position < parser.count) {
+		fprintf(stderr, "test: %s: unexpected argument\n", parser.args[parser.position]);
+		parser.error = true;
+	}
+	return (result && !parser.error) ? 0 : 1;
+}
+
+// function to tell if name is a valid variable name, a letter or _ followed by letters, digits and _
+bool validVariableName(const char* name, size_t length)
+{
+	if (length == 0 || !(isalpha((unsigned char)name[0]) || name[0] == '_')) {
+		return false;
+	}
+	for (size_t i = 1; i < length; i++)
+	{
+		if (!isalnum((unsigned char)name[i]) && name[i] != '_') {
+			return false;
+		}
+	}
+	return true;
+}
+
+// function for export command, NAME=value sets a variable in the environment of the shell and its children. no arguments lists them
+int exportVariables(char* argv[], struct shellState* shell)
+{
+	if (argv[1] == NULL) {
+		for (char** variable = environ; *variable != NULL; variable++)
+		{
+			printf("export %s\n", *variable);
+		}
+		fflush(stdout);
+		return 0;
+	}
+
+	int status = 0;
+	for (int i = 1; argv[i] != NULL; i++)
+	{
+		// the name ends at the first =, a name alone is exported already if it is set at all
+		char* equals = strchr(argv[i], '=');
+		size_t length = equals != NULL ? (size_t)(equals - argv[i]) : strlen(argv[i]);
+		if (!validVariableName(argv[i], length)) {
+			printf("export: %s: not a valid variable name\n", argv[i]);
+			fflush(stdout);
+			status = 1;
+			continue;
+		}
+		if (equals != NULL) {
+			*equals = '\0';
+			setenv(argv[i], equals + 1, 1);
+			*equals = '=';
+		}
+	}
+	return status;
+}
+
+// function for unset command, removes variables from the environment
+int unsetVariables(char* argv[], struct shellState* shell)
+{
+	int status = 0;
+	for (int i = 1; argv[i] != NULL; i++)
+	{
+		if (!validVariableName(argv[i], strlen(argv[i]))) {
+			printf("unset: %s: not a valid variable name\n", argv[i]);
+			fflush(stdout);
+			status = 1;
+			continue;
+		}
+		unsetenv(argv[i]);
+	}
+	return status;
+}
+
+// function to find the job a %n, %% or %+ names, the last stage entry of it. no spec is the newest job. returns NULL if there is none, and prints why unless name is NULL
+struct job* findJobSpec(char* spec, char* name)
+{
+	int number = -1;
+	if (spec != NULL && spec[0] == '%' && isdigit((unsigned char)spec[1])) {
+		number = atoi(spec + 1);
+	}
+	else if (spec != NULL && strcmp(spec, "%%") != 0 && strcmp(spec, "%+") != 0) {
+		printf("%s: %s: no such job\n", name, spec);
+		fflush(stdout);
+		return NULL;
+	}
+
+	// the job with that number, or the one with the highest number
+	struct job* found = NULL;
+	for (int i = 0; i < JOB_TABLE.capacity; i++)
+	{
+		struct job* job = &JOB_TABLE.jobs[i];
+		if (job->pid != 0 && !job->silent && (number == -1 ? (found == NULL || job->number > found->number) : job->number == number)) {
+			found = job;
+		}
+	}
+	if (found == NULL && name != NULL) {
+		printf(number == -1 ? "%s: no current job\n" : "%s: %s: no such job\n", name, spec);
+		fflush(stdout);
+	}
+	return found;
+}
+
+// function to compare jobs by number for qsort
+int compareJobNumbers(const void* a, const void* b)
+{
+	return (*(struct job* const*)a)->number - (*(struct job* const*)b)->number;
+}
+
+// function for jobs command, lists background jobs by number: jobs [-p]. jobs -o [%n] prints what a job wrote, if capture was on when it started
+int listJobs(char* argv[], struct shellState* shell)
+{
+	bool pidsOnly = argv[1] != NULL && strcmp(argv[1], "-p") == 0;
+	if (argv[1] != NULL && strcmp(argv[1], "-o") == 0) {
+		if (printCapture(argv[2]) == -1) {
+			printf(argv[2] != NULL ? "jobs: %s: no captured output\n" : "jobs: no captured output\n", argv[2]);
+			fflush(stdout);
+			return 1;
+		}
+		return 0;
+	}
+
+	// reported jobs are the last stage of every pipeline
+	struct job** jobs = malloc((JOB_TABLE.count ? JOB_TABLE.count : 1) * sizeof(struct job*));
+	int count = 0;
+	for (int i = 0; i < JOB_TABLE.capacity; i++)
+	{
+		if (JOB_TABLE.jobs[i].pid != 0 && !JOB_TABLE.jobs[i].silent) {
+			jobs[count++] = &JOB_TABLE.jobs[i];
+		}
+	}
+	qsort(jobs, count, sizeof(struct job*), compareJobNumbers);
+	for (int i = 0; i < count; i++)
+	{
+		if (pidsOnly) {
+			printf("%d\n", jobs[i]->pid);
+		}
+		else {
+			printf("[%d] %-8s %d  %s\n", jobs[i]->number, jobs[i]->stopped ? "Stopped" : "Running", jobs[i]->pid, jobs[i]->command);
+		}
+	}
+	fflush(stdout);
+	free(jobs);
+	return 0;
+}
+
+// function to count the processes of job number that are still in the job table and not stopped, of every job when number is 0.
+// stopped is set if some are in the table but stopped, those only go on after a signal so wait does not wait for them
+int runningProcesses(int number, bool* stopped)
+{
+	int running = 0;
+	*stopped = false;
+	for (int i = 0; i < JOB_TABLE.capacity; i++)
+	{
+		if (JOB_TABLE.jobs[i].pid != 0 && (number == 0 || JOB_TABLE.jobs[i].number == number)) {
+			if (JOB_TABLE.jobs[i].stopped) {
+				*stopped = true;
+			}
+			else {
+				running++;
+			}
+		}
+	}
+	return running;
+}
+
+// function to block until a child changes state and reap it, the signalfd wakes the shell so nothing is polled
+void waitForChildren(void)
+{
+	struct pollfd childFD = { SIGCHLD_FD, POLLIN, 0 };
+	poll(&childFD, 1, -1);
+	reapJobs(false);
+}
+
+// function to find the newest finished job with pid, or with number when pid is 0. NULL if it is not kept anymore
+struct finishedJob* findFinishedJob(pid_t pid, int number)
+{
+	for (unsigned long i = FINISHED_COUNT; i > 0 && i + FINISHED_JOB_COUNT > FINISHED_COUNT; i--)
+	{
+		struct finishedJob* finished = &FINISHED_JOBS[(i - 1) % FINISHED_JOB_COUNT];
+		if (pid ? finished->pid == pid : finished->number == number) {
+			return finished;
+		}
+	}
+	return NULL;
+}
+
+// function for wait command, waits for the jobs or pids given, or every job. status is the one of the last one waited for: wait [%n|pid ...]
+int waitCommand(char* argv[], struct shellState* shell)
+{
+	// every job that runs, relays included so output files are complete
+	bool stopped;
+	reapJobs(false);
+	if (argv[1] == NULL) {
+		while (runningProcesses(0, &stopped) > 0) {
+			waitForChildren();
+		}
+		if (stopped) {
+			printf("wait: stopped jobs are not waited for\n");
+			fflush(stdout);
+		}
+		return 0;
+	}
+
+	int status = 0;
+	for (int i = 1; argv[i] != NULL; i++)
+	{
+		// a job is waited for until every process of it is gone, a pid until it is
+		int number = 0;
+		pid_t pid = 0;
+		if (argv[i][0] == '%' && isdigit((unsigned char)argv[i][1])) {
+			number = atoi(argv[i] + 1);
+			struct job* job = findJobSpec(argv[i], NULL);
+			pid = job != NULL ? job->pid : 0;
+		}
+		else if (argv[i][0] == '%') {
+			struct job* job = findJobSpec(argv[i], "wait");
+			if (job == NULL) {
+				status = 127;
+				continue;
+			}
+			number = job->number;
+			pid = job->pid;
+		}
+		else {
+			pid = atoi(argv[i]);
+		}
+		struct job* job;
+		while (number ? runningProcesses(number, &stopped) > 0 : pid > 0 && (job = findJob(pid)) != NULL && !job->stopped) {
+			waitForChildren();
+		}
+		if (number ? runningProcesses(number, &stopped) == 0 && stopped : pid > 0 && (job = findJob(pid)) != NULL && job->stopped) {
+			printf("wait: %s is stopped\n", argv[i]);
+			fflush(stdout);
+			status = 1;
+			continue;
+		}
+
+		// the status comes from the finished jobs, a job that ended before wait was called is there too
+		struct finishedJob* finished = findFinishedJob(pid, number);
+		if (finished == NULL) {
+			printf(number ? "wait: %s: no such job\n" : "wait: pid %s is not a child of this shell\n", argv[i]);
+			fflush(stdout);
+			status = 127;
+			continue;
+		}
+		status = finished->status;
+		SIGNAL_NUMBER = finished->signalNumber;
+	}
+	return status;
+}
+
+// function for fg command, brings a job to the foreground and waits for it. the terminal is handed to its process group meanwhile: fg [%n]
+int foregroundCommand(char* argv[], struct shellState* shell)
+{
+	struct job* job = findJobSpec(argv[1], "fg");
+	if (job == NULL) {
+		return 1;
+	}
+	int number = job->number;
+	pid_t group = job->group;
+	printf("%s\n", job->command);
+	fflush(stdout);
+
+	// the job reads the terminal and gets ^C and ^Z from now on, the shell ignores SIGTTOU so it can take the terminal back
+	bool terminal = shell->input->interactive && tcgetpgrp(STDIN_FILENO) == getpgrp();
+	if (terminal) {
+		tcsetpgrp(STDIN_FILENO, group);
+	}
+	killpg(group, SIGCONT);
+
+	// wait for every process of the job like a foreground pipeline, a stopped one sends the job back to the background
+	int status = 0, stageSignal = 0;
+	bool stopped = false;
+	for (int i = 0; i < JOB_TABLE.capacity && !stopped; i++)
+	{
+		struct job* entry = &JOB_TABLE.jobs[i];
+		if (entry->pid == 0 || entry->number != number) {
+			continue;
+		}
+		entry->stopped = false;
+
+		int childStatus;
+		pid_t pid = entry->pid;
+		pid_t waited;
+		while ((waited = waitpid(pid, &childStatus, WUNTRACED)) == -1 && errno == EINTR);
+		if (waited == pid && WIFSTOPPED(childStatus)) {
+			entry->stopped = true;
+			stopped = true;
+			continue;
+		}
+		if (waited == pid && !entry->silent) {
+			status = convertStatus(childStatus, &stageSignal);
+		}
+		removeJob(pid);
+	}
+	if (terminal) {
+		tcsetpgrp(STDIN_FILENO, getpgrp());
+	}
+
+	if (stopped) {
+		printf("[%d] Stopped\n", number);
+		fflush(stdout);
+		return 1;
+	}
+	SIGNAL_NUMBER = stageSignal;
+	if (SIGNAL_NUMBER != 0) {
+		printf("terminated by signal %d\n", SIGNAL_NUMBER);
+		fflush(stdout);
+	}
+	return status;
+}
+
+// function for bg command, lets a stopped job go on in the background: bg [%n]
+int backgroundCommand(char* argv[], struct shellState* shell)
+{
+	struct job* job = findJobSpec(argv[1], "bg");
+	if (job == NULL) {
+		return 1;
+	}
+	if (killpg(job->group, SIGCONT) == -1) {
+		perror("bg");
+		fflush(stdout);
+		return 1;
+	}
+	printf("[%d] %s &\n", job->number, job->command);
+	fflush(stdout);
+	return 0;
+}
+
+// function to read a signal name or number like TERM, SIGTERM or 15. -1 if it is not one
+int signalNumber(char* name)
+{
+	if (isdigit((unsigned char)name[0])) {
+		int number = atoi(name);
+		return number > 0 && number < NSIG ? number : -1;
+	}
+	if (strncasecmp(name, "SIG", 3) == 0) {
+		name += 3;
+	}
+	for (int number = 1; number < NSIG; number++)
+	{
+		const char* abbreviation = sigabbrev_np(number);
+		if (abbreviation != NULL && strcasecmp(abbreviation, name) == 0) {
+			return number;
+		}
+	}
+	return -1;
+}
+
+// function for kill command, a %n sends the signal to the whole process group of a job: kill [-signal | -s signal | -l] %n|pid ...
+int killCommand(char* argv[], struct shellState* shell)
+{
+	// kill -l lists the signal names
+	if (argv[1] != NULL && strcmp(argv[1], "-l") == 0) {
+		for (int number = 1; number < NSIG; number++)
+		{
+			if (sigabbrev_np(number) != NULL) {
+				printf("%2d) SIG%s\n", number, sigabbrev_np(number));
+			}
+		}
+		fflush(stdout);
+		return 0;
+	}
+
+	// TERM unless a signal is given first
+	int signal = SIGTERM, i = 1;
+	if (argv[i] != NULL && strcmp(argv[i], "-s") == 0 && argv[i + 1] != NULL) {
+		signal = signalNumber(argv[i + 1]);
+		i += 2;
+	}
+	else if (argv[i] != NULL && argv[i][0] == '-' && argv[i][1] != '\0') {
+		signal = signalNumber(argv[i] + 1);
+		i++;
+	}
+	if (signal == -1 || argv[i] == NULL) {
+		printf("usage: kill [-signal | -s signal | -l] %%n|pid ...\n");
+		fflush(stdout);
+		return 1;
+	}
+
+	int status = 0;
+	for (; argv[i] != NULL; i++)
+	{
+		int result;
+		if (argv[i][0] == '%') {
+			struct job* job = findJobSpec(argv[i], "kill");
+			if (job == NULL) {
+				status = 1;
+				continue;
+			}
+			result = killpg(job->group, signal);
+		}
+		else {
+			// only a whole positive number is a pid, 0 or a negative one would signal a process group, maybe the shell's own
+			char* end;
+			errno = 0;
+			long pid = strtol(argv[i], &end, 10);
+			if (end == argv[i] || *end != '\0' || errno != 0 || pid <= 0 || pid > INT_MAX) {
+				printf("kill: %s: arguments must be process or job IDs\n", argv[i]);
+				fflush(stdout);
+				status = 1;
+				continue;
+			}
+			result = kill((pid_t)pid, signal);
+		}
+		if (result == -1) {
+			printf("kill: %s: %s\n", argv[i], strerror(errno));
+			fflush(stdout);
+			status = 1;
+		}
+	}
+	return status;
+}
+
+// function to find the latency below which a share of the runs of a command fall, in microseconds
+double statsPercentile(struct commandStats* stats, double share)
+{
+	unsigned long wanted = (unsigned long)(share * stats->count + 0.999999), seen = 0;
+	for (int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++)
+	{
+		seen += stats->buckets[bucket];
+		if (seen >= wanted && seen > 0) {
+			return bucketLatency(bucket);
+		}
+	}
+	return 0;
+}
+
+// function to compare stats by run count, most runs first, for qsort
+int compareStats(const void* a, const void* b)
+{
+	unsigned long first = (*(struct commandStats* const*)a)->count, second = (*(struct commandStats* const*)b)->count;
+	return first < second ? 1 : first > second ? -1 : 0;
+}
+
+// function for stats command, prints runs, latency percentiles and failure rate of every command or of one: stats [command]
+int statsCommand(char* argv[], struct shellState* shell)
 {
-    char* value;
-    struct command* next;
+	// every command name that ran, most runs first
+	int count = 0, capacity = 16;
+	struct commandStats** rows = malloc(capacity * sizeof(struct commandStats*));
+	for (int i = 0; i < STATS_TABLE_SIZE; i++)
+	{
+		for (struct commandStats* stats = COMMAND_STATS[i]; stats != NULL; stats = stats->next)
+		{
+			if (argv[1] != NULL && strcmp(argv[1], stats->name) != 0) {
+				continue;
+			}
+			if (count == capacity) {
+				capacity *= 2;
+				rows = realloc(rows, capacity * sizeof(struct commandStats*));
+			}
+			rows[count++] = stats;
+		}
+	}
+	if (argv[1] != NULL && count == 0) {
+		printf("stats: %s has not run\n", argv[1]);
+		fflush(stdout);
+		free(rows);
+		return 1;
+	}
+	qsort(rows, count, sizeof(struct commandStats*), compareStats);
+
+	// latencies come from the histogram, within 1/32 of the real value
+	printf("%-20s %8s %10s %10s %10s %7s\n", "command", "runs", "p50 ms", "p90 ms", "p99 ms", "failed");
+	for (int i = 0; i < count; i++)
+	{
+		struct commandStats* stats = rows[i];
+		printf("%-20s %8lu %10.3f %10.3f %10.3f %6.1f%%\n", stats->name, stats->count, statsPercentile(stats, 0.50) / 1000,
+			statsPercentile(stats, 0.90) / 1000, statsPercentile(stats, 0.99) / 1000, 100.0 * stats->failures / stats->count);
+	}
+	fflush(stdout);
+	free(rows);
+	return 0;
+}
+
+/* Every builtin, sorted by name for bsearch */
+struct builtin BUILTINS[] = {
+	{ "[", testCommand, true },
+	{ "bg", backgroundCommand, false },
+	{ "break", breakLoop, false },
+	{ "cd", changeDirectory, false },
+	{ "continue", breakLoop, false },
+	{ "echo", echoCommand, true },
+	{ "exit", exitShell, false },
+	{ "export", exportVariables, false },
+	{ "false", falseCommand, true },
+	{ "fg", foregroundCommand, false },
+	{ "hash", hashCommand, false },
+	{ "history", historyCommand, false },
+	{ "jobs", listJobs, false },
+	{ "kill", killCommand, false },
+	{ "memstats", showMemoryStats, false },
+	{ "parallel", parallelCommand, false },
+	{ "printf", printfCommand, true },
+	{ "return", returnCommand, false },
+	{ "set", setOption, false },
+	{ "stats", statsCommand, false },
+	{ "status", showStatus, false },
+	{ "test", testCommand, true },
+	{ "true", trueCommand, true },
+	{ "unset", unsetVariables, false },
+	{ "wait", waitCommand, false },
 };
 
-/* A linked list struct to store zombie processes that run in background */
-struct zombieProcess
-{
-	bool killed;
-	int zombie_pid;
-	struct zombieProcess* next;
-};
+// a shell function runs like a builtin, its < and > files are swapped in around the whole body
+struct builtin FUNCTION_CALL = { "function", callFunction, false };
+
+// function to compare a command name with a builtin for bsearch
+int compareBuiltin(const void* name, const void* builtin)
+{
+	return strcmp(name, ((const struct builtin*)builtin)->name);
+}
+
+// function to find the builtin called name, NULL if there is none
+struct builtin* findBuiltin(char* name)
+{
+	return bsearch(name, BUILTINS, sizeof(BUILTINS) / sizeof(BUILTINS[0]), sizeof(struct builtin), compareBuiltin);
+}
+
+// function to run a builtin in the shell, its < and > files are swapped in for stdin and stdout while it runs
+int runBuiltin(struct builtin* builtin, struct pipelineStage* stage, struct shellState* shell)
+{
+	int sourceFD, targetFD;
+	pid_t fanoutPid;
+	if (openStageFiles(stage, false, false, false, &sourceFD, &targetFD, &fanoutPid) == -1) {
+		return 1;
+	}
+
+	// keep the shell's own stdin and stdout above the low fds, close-on-exec so no child inherits them
+	int savedIn = -1, savedOut = -1;
+	fflush(stdout);
+	if (sourceFD != -1) {
+		savedIn = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 10);
+		dup2(sourceFD, STDIN_FILENO);
+		close(sourceFD);
+	}
+	if (targetFD != -1) {
+		savedOut = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+		dup2(targetFD, STDOUT_FILENO);
+		close(targetFD);
+	}
+
+	bool inputRedirected = shell->inputRedirected;
+	shell->inputRedirected = inputRedirected || sourceFD != -1;
+	int status = builtin->run(stage->argv, shell);
+	shell->inputRedirected = inputRedirected;
+
+	// put stdin and stdout back, a closed one is closed again
+	fflush(stdout);
+	if (sourceFD != -1) {
+		if (savedIn != -1) {
+			dup2(savedIn, STDIN_FILENO);
+			close(savedIn);
+		}
+		else {
+			close(STDIN_FILENO);
+		}
+	}
+	if (targetFD != -1) {
+		if (savedOut != -1) {
+			dup2(savedOut, STDOUT_FILENO);
+			close(savedOut);
+		}
+		else {
+			close(STDOUT_FILENO);
+		}
+	}
+
+	// the fan-out relay is done once it has seen the end of the builtin's output
+	if (fanoutPid != -1) {
+		int childStatus;
+		while (waitpid(fanoutPid, &childStatus, 0) == -1 && errno == EINTR);
+	}
+	return status;
+}
+
+// function to add an empty node to the command trie, returns its index
+int newTrieNode(unsigned char c)
+{
+	if (COMMAND_TRIE.count == COMMAND_TRIE.capacity) {
+		COMMAND_TRIE.capacity = COMMAND_TRIE.capacity ? COMMAND_TRIE.capacity * 2 : 4096;
+		COMMAND_TRIE.nodes = realloc(COMMAND_TRIE.nodes, COMMAND_TRIE.capacity * sizeof(struct trieNode));
+	}
+	struct trieNode* node = &COMMAND_TRIE.nodes[COMMAND_TRIE.count];
+	node->firstChild = -1;
+	node->nextSibling = -1;
+	node->names = 0;
+	node->c = c;
+	node->terminal = false;
+	return COMMAND_TRIE.count++;
+}
+
+// function to add a command name to the trie, a name that is already in it is left alone
+void trieInsert(const char* name)
+{
+	// nodes on the way down, names longer than a file name cannot be commands
+	int path[NAME_MAX + 1];
+	size_t depth = 0;
+	int node = 0;
+	path[depth++] = node;
+	for (const unsigned char* c = (const unsigned char*)name; *c; c++)
+	{
+		if (depth > NAME_MAX) {
+			return;
+		}
+
+		// siblings are in character order, a missing child goes where the order wants it
+		int previous = -1, child = COMMAND_TRIE.nodes[node].firstChild;
+		while (child != -1 && COMMAND_TRIE.nodes[child].c < *c) {
+			previous = child;
+			child = COMMAND_TRIE.nodes[child].nextSibling;
+		}
+		if (child == -1 || COMMAND_TRIE.nodes[child].c != *c) {
+			int added = newTrieNode(*c);
+			COMMAND_TRIE.nodes[added].nextSibling = child;
+			if (previous == -1) {
+				COMMAND_TRIE.nodes[node].firstChild = added;
+			}
+			else {
+				COMMAND_TRIE.nodes[previous].nextSibling = added;
+			}
+			child = added;
+		}
+		node = child;
+		path[depth++] = node;
+	}
+
+	// the same command in two PATH directories counts once
+	if (COMMAND_TRIE.nodes[node].terminal) {
+		return;
+	}
+	COMMAND_TRIE.nodes[node].terminal = true;
+	for (size_t i = 0; i < depth; i++) {
+		COMMAND_TRIE.nodes[path[i]].names++;
+	}
+}
+
+// function to make the command trie match PATH. it is built again when PATH or the mtime of one of its directories changed,
+// so a Tab costs a stat per directory
+void refreshCommandTrie(void)
+{
+	refreshPathDirs();
+
+	// the trie is good if it was built for this PATH and no directory got a file added or removed since
+	bool fresh = COMMAND_TRIE.pathCopy != NULL && strcmp(COMMAND_TRIE.pathCopy, PATH_CACHE.pathCopy) == 0;
+	struct stat dirStat;
+	for (int i = 0; fresh && i < COMMAND_TRIE.dirCount; i++)
+	{
+		struct timespec mtime = { 0, 0 };
+		if (stat(PATH_CACHE.dirs[i], &dirStat) == 0) {
+			mtime = dirStat.st_mtim;
+		}
+		if (mtime.tv_sec != COMMAND_TRIE.dirMtimes[i].tv_sec || mtime.tv_nsec != COMMAND_TRIE.dirMtimes[i].tv_nsec) {
+			fresh = false;
+		}
+	}
+	if (fresh) {
+		return;
+	}
+
+	// start over with only the root, nodes are kept for the new names
+	COMMAND_TRIE.count = 0;
+	newTrieNode('\0');
+	free(COMMAND_TRIE.pathCopy);
+	free(COMMAND_TRIE.dirMtimes);
+	COMMAND_TRIE.pathCopy = strdup(PATH_CACHE.pathCopy);
+	COMMAND_TRIE.dirCount = PATH_CACHE.dirCount;
+	COMMAND_TRIE.dirMtimes = calloc(PATH_CACHE.dirCount, sizeof(struct timespec));
+
+	for (int i = 0; i < PATH_CACHE.dirCount; i++)
+	{
+		// mtime is taken before the directory is read, a file added meanwhile shows up at the next Tab
+		if (stat(PATH_CACHE.dirs[i], &dirStat) == 0) {
+			COMMAND_TRIE.dirMtimes[i] = dirStat.st_mtim;
+		}
+		DIR* directory = opendir(PATH_CACHE.dirs[i]);
+		if (directory == NULL) {
+			continue;
+		}
+
+		// regular files that can be executed, d_type saves a stat for everything but links
+		struct dirent* entry;
+		while ((entry = readdir(directory)) != NULL)
+		{
+			if (entry->d_name[0] == '.' || entry->d_type == DT_DIR) {
+				continue;
+			}
+			struct stat fileStat;
+			if (entry->d_type != DT_REG && (fstatat(dirfd(directory), entry->d_name, &fileStat, 0) == -1 || !S_ISREG(fileStat.st_mode))) {
+				continue;
+			}
+			if (faccessat(dirfd(directory), entry->d_name, X_OK, 0) == 0) {
+				trieInsert(entry->d_name);
+			}
+		}
+		closedir(directory);
+	}
+
+	// builtins complete like commands
+	for (size_t i = 0; i < sizeof(BUILTINS) / sizeof(BUILTINS[0]); i++) {
+		trieInsert(BUILTINS[i].name);
+	}
+}
+
+// function to put the names below node into names, in order. name holds the characters down to node
+void trieNames(int node, char* name, size_t depth, char** names, int* count)
+{
+	if (COMMAND_TRIE.nodes[node].terminal) {
+		names[(*count)++] = strndup(name, depth);
+	}
+	for (int child = COMMAND_TRIE.nodes[node].firstChild; child != -1; child = COMMAND_TRIE.nodes[child].nextSibling)
+	{
+		name[depth] = COMMAND_TRIE.nodes[child].c;
+		trieNames(child, name, depth + 1, names, count);
+	}
+}
+
+// function to print the names a Tab could complete to in columns as wide as the terminal, below the line being edited
+void printCandidates(char** names, int count)
+{
+	struct winsize window;
+	int width = ioctl(STDOUT_FILENO, TIOCGWINSZ, &window) == 0 && window.ws_col > 0 ? window.ws_col : 80;
+	size_t longest = 1;
+	for (int i = 0; i < count; i++) {
+		if (strlen(names[i]) > longest) {
+			longest = strlen(names[i]);
+		}
+	}
+
+	// names go down the columns, like ls
+	int columns = width / (int)(longest + 2);
+	if (columns < 1) {
+		columns = 1;
+	}
+	int rows = (count + columns - 1) / columns;
+	printf("\n");
+	for (int row = 0; row < rows; row++)
+	{
+		for (int column = 0; column < columns; column++)
+		{
+			int i = column * rows + row;
+			if (i < count) {
+				printf("%-*s", (int)(i + rows < count ? longest + 2 : 0), names[i]);
+			}
+		}
+		printf("\n");
+	}
+	fflush(stdout);
+}
+
+// function to complete a command name from the trie. extension gets the characters every match shares after the word,
+// list prints the matches when there is more than one. returns the number of matches
+int completeCommand(const char* word, size_t length, char* extension, size_t* extensionLength, bool list)
+{
+	refreshCommandTrie();
+	*extensionLength = 0;
+
+	// follow the word down the trie
+	int node = 0;
+	for (size_t i = 0; i < length && node != -1; i++)
+	{
+		int child = COMMAND_TRIE.nodes[node].firstChild;
+		while (child != -1 && COMMAND_TRIE.nodes[child].c < (unsigned char)word[i]) {
+			child = COMMAND_TRIE.nodes[child].nextSibling;
+		}
+		node = child != -1 && COMMAND_TRIE.nodes[child].c == (unsigned char)word[i] ? child : -1;
+	}
+	if (node == -1) {
+		return 0;
+	}
+
+	// every match shares the characters down to the first fork or the first name that ends
+	int shared = node;
+	while (!COMMAND_TRIE.nodes[shared].terminal && COMMAND_TRIE.nodes[shared].firstChild != -1
+		&& COMMAND_TRIE.nodes[COMMAND_TRIE.nodes[shared].firstChild].nextSibling == -1 && length + *extensionLength < NAME_MAX)
+	{
+		shared = COMMAND_TRIE.nodes[shared].firstChild;
+		extension[(*extensionLength)++] = COMMAND_TRIE.nodes[shared].c;
+	}
+
+	// matches are only walked when they are listed
+	int matches = COMMAND_TRIE.nodes[node].names;
+	if (list && matches > 1 && *extensionLength == 0)
+	{
+		char name[NAME_MAX + 1];
+		char** names = malloc(matches * sizeof(char*));
+		int count = 0;
+		memcpy(name, word, length);
+		trieNames(node, name, length, names, &count);
+		printCandidates(names, count);
+		for (int i = 0; i < count; i++) {
+			free(names[i]);
+		}
+		free(names);
+	}
+	return matches;
+}
+
+// function to read a directory into the cache unless it is the one already there and did not change. returns -1 if it cannot be read
+int loadDirectory(const char* path)
+{
+	struct stat dirStat;
+	if (stat(path, &dirStat) == -1) {
+		return -1;
+	}
+	if (DIRECTORY_CACHE.loaded && DIRECTORY_CACHE.device == dirStat.st_dev && DIRECTORY_CACHE.inode == dirStat.st_ino
+		&& DIRECTORY_CACHE.mtime.tv_sec == dirStat.st_mtim.tv_sec && DIRECTORY_CACHE.mtime.tv_nsec == dirStat.st_mtim.tv_nsec) {
+		return 0;
+	}
+
+	// forget the old listing
+	for (int i = 0; i < DIRECTORY_CACHE.count; i++) {
+		free(DIRECTORY_CACHE.names[i]);
+	}
+	free(DIRECTORY_CACHE.names);
+	free(DIRECTORY_CACHE.isDirectory);
+	DIRECTORY_CACHE.names = NULL;
+	DIRECTORY_CACHE.isDirectory = NULL;
+	DIRECTORY_CACHE.count = 0;
+	DIRECTORY_CACHE.loaded = false;
+
+	DIR* directory = opendir(path);
+	if (directory == NULL) {
+		return -1;
+	}
+	int capacity = 0;
+	struct dirent* entry;
+	while ((entry = readdir(directory)) != NULL)
+	{
+		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+			continue;
+		}
+		if (DIRECTORY_CACHE.count == capacity) {
+			capacity = capacity ? capacity * 2 : 64;
+			DIRECTORY_CACHE.names = realloc(DIRECTORY_CACHE.names, capacity * sizeof(char*));
+		}
+		DIRECTORY_CACHE.names[DIRECTORY_CACHE.count++] = strdup(entry->d_name);
+	}
+
+	// sorted, so the names with a prefix are one run a binary search finds
+	qsort(DIRECTORY_CACHE.names, DIRECTORY_CACHE.count, sizeof(char*), compareNames);
+	DIRECTORY_CACHE.isDirectory = malloc((DIRECTORY_CACHE.count ? DIRECTORY_CACHE.count : 1) * sizeof(bool));
+	for (int i = 0; i < DIRECTORY_CACHE.count; i++)
+	{
+		struct stat fileStat;
+		DIRECTORY_CACHE.isDirectory[i] = fstatat(dirfd(directory), DIRECTORY_CACHE.names[i], &fileStat, 0) == 0 && S_ISDIR(fileStat.st_mode);
+	}
+	closedir(directory);
+	DIRECTORY_CACHE.device = dirStat.st_dev;
+	DIRECTORY_CACHE.inode = dirStat.st_ino;
+	DIRECTORY_CACHE.mtime = dirStat.st_mtim;
+	DIRECTORY_CACHE.loaded = true;
+	return 0;
+}
 
-/* function to substitute string from https://www.geeksforgeeks.org/c-program-replace-word-text-another-given-word/  used to replace $$ with pid */
-char* substituteString(const char* s, const char* oldW, const char* newW)
+// function to complete a file name from the cached listing of its directory, like completeCommand. directory is set when the one match is a directory
+int completeFile(const char* word, size_t length, char* extension, size_t* extensionLength, bool* directory, bool list)
 {
-	char* result;
-	int i, cnt = 0;
-	int newWlen = strlen(newW);
-	int oldWlen = strlen(oldW);
-
-	// Counting the number of times old word occur in the string
-	for (i = 0; s[i] != '\0'; i++) {
-		if (strstr(&s[i], oldW) == &s[i]) {
-			cnt++;
+	*extensionLength = 0;
 
-			// Jumping to index after the old word.
-			i += oldWlen - 1;
+	// the directory is what comes before the last /, ~/ is the home directory
+	char dirPath[4096];
+	const char* name = word;
+	size_t nameLength = length;
+	const char* slash = memrchr(word, '/', length);
+	if (slash == NULL) {
+		strcpy(dirPath, ".");
+	}
+	else {
+		size_t dirLength = slash - word + 1;
+		char* home = getenv("HOME");
+		if (word[0] == '~' && word[1] == '/' && home != NULL) {
+			snprintf(dirPath, sizeof(dirPath), "%s%.*s", home, (int)dirLength - 1, word + 1);
 		}
+		else {
+			snprintf(dirPath, sizeof(dirPath), "%.*s", (int)dirLength, word);
+		}
+		name = slash + 1;
+		nameLength = length - dirLength;
+	}
+	if (loadDirectory(dirPath) == -1) {
+		return 0;
 	}
 
-	// Making new string of enough length
-	result = (char*)malloc(i + cnt * (newWlen - oldWlen) + 1);
+	// first name that is not before the prefix
+	int low = 0, high = DIRECTORY_CACHE.count;
+	while (low < high)
+	{
+		int middle = (low + high) / 2;
+		if (strncmp(DIRECTORY_CACHE.names[middle], name, nameLength) < 0) {
+			low = middle + 1;
+		}
+		else {
+			high = middle;
+		}
+	}
 
-	i = 0;
-	while (*s) {
-		// compare the substring with the result
-		if (strstr(s, oldW) == s) {
-			strcpy(&result[i], newW);
-			i += newWlen;
-			s += oldWlen;
+	// matches and what they share, hidden files only when the word asks for them
+	char** matches = malloc((DIRECTORY_CACHE.count ? DIRECTORY_CACHE.count : 1) * sizeof(char*));
+	int count = 0, last = 0;
+	size_t shared = 0;
+	for (int i = low; i < DIRECTORY_CACHE.count && strncmp(DIRECTORY_CACHE.names[i], name, nameLength) == 0; i++)
+	{
+		char* match = DIRECTORY_CACHE.names[i];
+		if (match[0] == '.' && nameLength == 0) {
+			continue;
 		}
-		else
-			result[i++] = *s++;
+		if (count == 0) {
+			shared = strlen(match + nameLength);
+		}
+		else {
+			size_t j = 0;
+			while (j < shared && match[nameLength + j] == matches[0][nameLength + j]) {
+				j++;
+			}
+			shared = j;
+		}
+		matches[count++] = match;
+		last = i;
 	}
-	result[i] = '\0';
-	return result;
+	if (count > 0) {
+		if (shared > NAME_MAX) {
+			shared = NAME_MAX;
+		}
+		memcpy(extension, matches[0] + nameLength, shared);
+		*extensionLength = shared;
+		*directory = count == 1 && DIRECTORY_CACHE.isDirectory[last];
+	}
+	if (list && count > 1 && shared == 0) {
+		printCandidates(matches, count);
+	}
+	free(matches);
+	return count;
 }
 
-// function to create zombie list
-struct zombieProcess* makeZombie(void)
+// function to draw the prompt and the line again. a line wider than the terminal scrolls sideways so the cursor stays in view
+void drawLine(const char* line, size_t length, size_t cursor)
 {
-	// from heap generate enough data for a struct
-	struct zombieProcess* zombie = malloc(sizeof(struct zombieProcess));
-	zombie->killed = false;
-	zombie->next = NULL;
-	zombie->zombie_pid = 0;
-	return zombie;
+	struct winsize window;
+	size_t width = ioctl(STDOUT_FILENO, TIOCGWINSZ, &window) == 0 && window.ws_col > 3 ? window.ws_col - 3 : 77;
+	size_t first = cursor > width ? cursor - width : 0;
+	size_t shown = length - first < width ? length - first : width;
+
+	// one write: back to the start, prompt, text, clear the rest, cursor to its column
+	char* output = malloc(shown + 32);
+	int size = sprintf(output, "\r%s", PROMPT);
+	memcpy(output + size, line + first, shown);
+	size += shown;
+	size += sprintf(output + size, "\x1b[K\r\x1b[%zuC", cursor - first + 2);
+	writeAll(STDOUT_FILENO, output, size);
+	free(output);
 }
 
-// The signal handler for SIGSTP - only for main process
-void handle_SIGTSTP(int signo) {
-	if (!FOREGROUND_ONLY) {
-		char* message = "\nEntering foreground-only mode (& is now ignored)\n";
-		FOREGROUND_ONLY = true;
-		// reentrant function
-		write(STDOUT_FILENO, message, 50);
-		fflush(stdout);
+// function to wait for the next byte typed at the terminal, finished jobs are announced meanwhile.
+// returns the byte, -1 at end of input and -2 when something was printed over the line
+int editorByte(struct lineReader* reader)
+{
+	while (reader->start == reader->end)
+	{
+		struct pollfd waitFDs[2] = { { reader->fd, POLLIN, 0 }, { SIGCHLD_FD, POLLIN, 0 } };
+		if (poll(waitFDs, 2, -1) == -1) {
+			// ^Z handler printed its message
+			if (errno == EINTR) {
+				return -2;
+			}
+			continue;
+		}
+		if ((waitFDs[1].revents & POLLIN) && reapJobs(true) > 0) {
+			return -2;
+		}
+		if (!(waitFDs[0].revents & (POLLIN | POLLHUP))) {
+			continue;
+		}
+		ssize_t count = read(reader->fd, reader->buffer, reader->capacity);
+		if (count > 0) {
+			reader->start = 0;
+			reader->end = count;
+		}
+		else if (count == 0 || errno != EINTR) {
+			reader->eof = true;
+			return -1;
+		}
 	}
-	else {
-		char* message = "\nExiting foreground-only mode\n";
-		FOREGROUND_ONLY = false;
-		// reentrant function
-		write(STDOUT_FILENO, message, 30);
-		fflush(stdout);
+	return (unsigned char)reader->buffer[reader->start++];
+}
+
+// function to put text over the line being edited, for history entries
+void replaceLine(char** line, size_t* capacity, size_t* length, size_t* cursor, const char* text, size_t textLength)
+{
+	while (textLength + 2 > *capacity) {
+		*capacity *= 2;
+		*line = realloc(*line, *capacity);
 	}
+	memcpy(*line, text, textLength);
+	*length = textLength;
+	*cursor = textLength;
 }
 
-// The signal handler for SIGINT - only for child foreground process
-void handle_SIGINT(int signo) {
-	char* message = "terminated by signal ";
-	// reentrant function
-	write(STDOUT_FILENO, message, 21);
-	fflush(stdout);
+// function to read a command line from a terminal in raw mode with cursor keys, history and Tab completion.
+// returns what readCommandLine would: the line with its new line, 0 if interrupted and -1 at end of input
+ssize_t editLine(struct lineReader* reader, char** line, size_t* capacity)
+{
+	// keys come one at a time without echo, ^C and ^Z still raise their signals
+	struct termios original, raw;
+	if (tcgetattr(reader->fd, &original) == -1) {
+		return readCommandLine(reader, line, capacity);
+	}
+	raw = original;
+	raw.c_lflag &= ~(ICANON | ECHO | IEXTEN);
+	raw.c_iflag &= ~(ICRNL | IXON);
+	raw.c_cc[VMIN] = 1;
+	raw.c_cc[VTIME] = 0;
+	tcsetattr(reader->fd, TCSADRAIN, &raw);
+
+	if (*line == NULL || *capacity == 0) {
+		*capacity = 256;
+		*line = realloc(*line, *capacity);
+	}
+	size_t length = 0, cursor = 0;
+
+	// history is read on the first up arrow. browsing is the entry shown, typed keeps the line from before browsing
+	int historyCount = -1, browsing = 0;
+	char* typed = NULL;
+	size_t typedLength = 0;
+
+	// a second Tab in a row lists the matches when there is more than one
+	bool lastTab = false;
+	ssize_t result;
+	while (true)
+	{
+		// room for one more character, or the longest completion, and the new line
+		while (length + NAME_MAX + 3 > *capacity) {
+			*capacity *= 2;
+			*line = realloc(*line, *capacity);
+		}
+
+		int key = editorByte(reader);
+		bool tab = false;
+
+		// escape sequences of the arrow, Home, End and Delete keys
+		if (key == 27)
+		{
+			int kind = editorByte(reader);
+			int code = kind == '[' || kind == 'O' ? editorByte(reader) : -1;
+			if (code >= '0' && code <= '9') {
+				int end = editorByte(reader);
+				while (end >= 0 && end != '~') {
+					end = editorByte(reader);
+				}
+				key = code == '1' || code == '7' ? 1 : code == '4' || code == '8' ? 5 : code == '3' ? 127 + 256 : 0;
+			}
+			else {
+				key = code == 'A' ? 16 : code == 'B' ? 14 : code == 'C' ? 6 : code == 'D' ? 2 : code == 'H' ? 1 : code == 'F' ? 5 : 0;
+			}
+		}
+
+		// end of input ends the line, ^D on an empty line is end of input
+		if (key == -1 || (key == 4 && length == 0)) {
+			if (length == 0) {
+				printf("\n");
+				fflush(stdout);
+				result = -1;
+				break;
+			}
+			key = '\r';
+		}
+		if (key == '\r' || key == '\n') {
+			printf("\n");
+			fflush(stdout);
+			(*line)[length++] = '\n';
+			(*line)[length] = '\0';
+			result = length;
+			break;
+		}
+
+		switch (key)
+		{
+		case -2: // something was printed, the line is drawn again below
+			break;
+		case 1: // ^A, Home
+			cursor = 0;
+			break;
+		case 5: // ^E, End
+			cursor = length;
+			break;
+		case 2: // ^B, left
+			cursor -= cursor > 0;
+			break;
+		case 6: // ^F, right
+			cursor += cursor < length;
+			break;
+		case 127: // backspace
+		case 8:
+			if (cursor > 0) {
+				memmove(*line + cursor - 1, *line + cursor, length - cursor);
+				cursor--;
+				length--;
+			}
+			break;
+		case 4: // ^D and Delete take the character under the cursor
+		case 127 + 256:
+			if (cursor < length) {
+				memmove(*line + cursor, *line + cursor + 1, length - cursor - 1);
+				length--;
+			}
+			break;
+		case 11: // ^K, everything after the cursor
+			length = cursor;
+			break;
+		case 21: // ^U, everything before the cursor
+			memmove(*line, *line + cursor, length - cursor);
+			length -= cursor;
+			cursor = 0;
+			break;
+		case 23: // ^W, the word before the cursor
+		{
+			size_t start = cursor;
+			while (start > 0 && (*line)[start - 1] == ' ') {
+				start--;
+			}
+			while (start > 0 && (*line)[start - 1] != ' ') {
+				start--;
+			}
+			memmove(*line + start, *line + cursor, length - cursor);
+			length -= cursor - start;
+			cursor = start;
+			break;
+		}
+		case 12: // ^L, clear the screen
+			printf("\x1b[H\x1b[2J");
+			fflush(stdout);
+			break;
+		case 16: // ^P, up: an older entry
+			if (historyCount == -1) {
+				historyCount = syncHistory() == -1 ? 0 : (int)HISTORY.count;
+				browsing = historyCount;
+			}
+			if (browsing > 0) {
+				if (browsing == historyCount) {
+					free(typed);
+					typed = strndup(*line, length);
+					typedLength = length;
+				}
+				unsigned int textLength;
+				const char* text = historyText(--browsing, &textLength);
+				replaceLine(line, capacity, &length, &cursor, text, textLength);
+			}
+			break;
+		case 14: // ^N, down: a newer entry, past the newest one is the line that was being typed
+			if (historyCount != -1 && browsing < historyCount) {
+				unsigned int textLength;
+				const char* text = ++browsing == historyCount ? typed : historyText(browsing, &textLength);
+				replaceLine(line, capacity, &length, &cursor, text, browsing == historyCount ? typedLength : textLength);
+			}
+			break;
+		case '\t':
+		{
+			// the word under the cursor starts after the last blank or operator before it
+			size_t start = cursor;
+			while (start > 0 && strchr(" \t|<>&", (*line)[start - 1]) == NULL) {
+				start--;
+			}
+
+			// it is a command name when only blanks and a | come before it and it has no /
+			size_t before = start;
+			while (before > 0 && (*line)[before - 1] == ' ') {
+				before--;
+			}
+			bool commandWord = (before == 0 || (*line)[before - 1] == '|') && memchr(*line + start, '/', cursor - start) == NULL;
+
+			char extension[NAME_MAX + 2];
+			size_t extensionLength;
+			bool directory = false;
+			int matches = commandWord ? completeCommand(*line + start, cursor - start, extension, &extensionLength, lastTab)
+				: completeFile(*line + start, cursor - start, extension, &extensionLength, &directory, lastTab);
+
+			// a single match is finished off with a blank, or a / for a directory
+			if (matches == 1) {
+				extension[extensionLength++] = directory ? '/' : ' ';
+			}
+			if (matches == 0) {
+				writeAll(STDOUT_FILENO, "\a", 1);
+			}
+			memmove(*line + cursor + extensionLength, *line + cursor, length - cursor);
+			memcpy(*line + cursor, extension, extensionLength);
+			length += extensionLength;
+			cursor += extensionLength;
+			tab = matches > 1;
+			break;
+		}
+		default: // text goes in at the cursor, other control keys do nothing
+			if (key >= 32 && key < 256) {
+				memmove(*line + cursor + 1, *line + cursor, length - cursor);
+				(*line)[cursor++] = key;
+				length++;
+			}
+			break;
+		}
+		lastTab = tab;
+		drawLine(*line, length, cursor);
+	}
+
+	// commands run with the terminal the way it was
+	tcsetattr(reader->fd, TCSADRAIN, &original);
+	free(typed);
+	return result;
 }
 
-// function to create a struct of user command
-struct command* holdUserCommand(char* userInput)
-{
-	// bool to see if to substitute $$ with pid and variable for $$
-	bool substitute = false;
-	char* dollarSign = "$$";
-
-	// from heap generate enough data for a struct
-	struct command* userCommand = malloc(sizeof(struct command));
-
-	// pointer for string token finding and token
-	char* saveptr;
-	char* token = strtok_r(userInput, " ", &saveptr);
-	
-	// head and next node to assist in referencing next node
-	struct command* head = NULL;
-	struct command* next = NULL;
-
-	head = userCommand;
-	
-	// loop thru user command and make a linked list of each command and argument
-	while (token != NULL) {
-		// check if token contains $$
-		char* subString;
-		subString = strstr(token, dollarSign);
-
-		// if $$ found in string, call substituteString function
-		if (subString != NULL) {
-			// convert pid to ascii
-			int pid = getpid();
-			char intToStr[10];
-			sprintf(intToStr, "%d", pid);
-
-			// call substituteString function
-			char* updatedString = substituteString(token, dollarSign, intToStr);
-	
-			// copy into current node value
-			userCommand->value = calloc(strlen(updatedString) + 1, sizeof(char));
-			strcpy(userCommand->value, updatedString);
-
-			// set boolean to true
-			substitute = true;
+// function to run one command of a command line: tokenize it, take off the time and @cpus= prefixes, then run it as a builtin or a job.
+// returns its status, which $? gets too, or -1 if it could not be tokenized
+int runCommand(struct commandNode* node, struct shellState* shell)
+{
+	// tokenize user command into argv arrays and redirections, the background flag is on the node
+	struct parsedCommand* parsedCommand = parseCommandLine(shell->arena, node->text);
+	parsedCommand->background = node->background;
+	char** commandArgv = parsedCommand->stages[0].argv;
+	struct builtin* builtin;
+	int status;
+
+	// time prefix, the rest of the command runs as usual and what it used is printed afterwards
+	bool timed = parsedCommand->error == NULL && parsedCommand->stageCount > 0 && parsedCommand->stages[0].argc > 1 && strcmp("time", commandArgv[0]) == 0;
+	unsigned long jobsBefore = LAST_USAGE.count;
+	struct timespec timedStart;
+	struct rusage shellBefore;
+	if (timed) {
+		parsedCommand->stages[0].argv++;
+		parsedCommand->stages[0].argc--;
+		parsedCommand->argumentCount--;
+		commandArgv = parsedCommand->stages[0].argv;
+		clock_gettime(CLOCK_MONOTONIC, &timedStart);
+		getrusage(RUSAGE_SELF, &shellBefore);
+	}
+
+	// @cpus=list prefix runs the command on those cpus only, they have to be ones the shell may use
+	if (parsedCommand->error == NULL && parsedCommand->stageCount > 0 && parsedCommand->stages[0].argc > 1 && strncmp(commandArgv[0], "@cpus=", 6) == 0) {
+		parsedCommand->cpus = arenaAlloc(shell->arena, sizeof(cpu_set_t));
+		loadTopology();
+		if (parseCpuList(commandArgv[0] + 6, parsedCommand->cpus) == -1) {
+			parsedCommand->error = "Bad cpu list in command line!";
 		}
-		
-		// copy token directly if there is no substitution of $$
-		if (!substitute) {
-			// copy command into linked list 
-			userCommand->value = calloc(strlen(token) + 1, sizeof(char));
-			strcpy(userCommand->value, token);
+		else {
+			CPU_AND(parsedCommand->cpus, parsedCommand->cpus, &TOPOLOGY.allowed);
+			if (CPU_COUNT(parsedCommand->cpus) == 0) {
+				parsedCommand->error = "No usable cpu in cpu list in command line!";
+			}
 		}
-		
-		// create next node of linked list
-		next = userCommand;
-		next->next = malloc(sizeof(struct command));
-		userCommand = next->next;
+		parsedCommand->stages[0].argv++;
+		parsedCommand->stages[0].argc--;
+		parsedCommand->argumentCount--;
+		commandArgv = parsedCommand->stages[0].argv;
+	}
 
-		// find next token
-		token = strtok_r(NULL, " ", &saveptr);
+	// command cannot run, tell the user
+	if (parsedCommand->error != NULL) {
+		printf("%s\n", parsedCommand->error);
+		fflush(stdout);
+		return -1;
+	}
+	// nothing was left of the command after $( ), the status stays
+	else if (parsedCommand->stageCount == 0) {
+		return shell->status;
+	}
+	// a command of its own that is a function or builtin runs in the shell, the builtins that stand in for a program only when nothing needs a process.
+	// in a pipeline they are stages like any other, spawnProcess forks the shell for them
+	else if ((builtin = findFunction(commandArgv[0]) != NULL ? &FUNCTION_CALL : findBuiltin(commandArgv[0])) != NULL && parsedCommand->stageCount == 1 && (!builtin->replacesProgram || (parsedCommand->cpus == NULL && (!parsedCommand->background || FOREGROUND_ONLY)))) {
+		// builtins are in the stats too, the cpu time of the shell is only taken for a metrics log
+		struct timespec builtinStart;
+		struct rusage builtinBefore;
+		bool measured = METRICS_FD != -1;
+		clock_gettime(CLOCK_MONOTONIC, &builtinStart);
+		if (measured) {
+			getrusage(RUSAGE_SELF, &builtinBefore);
+		}
+		status = runBuiltin(builtin, &parsedCommand->stages[0], shell);
+		recordBuiltin(commandArgv[0], &builtinStart, measured ? &builtinBefore : NULL, status);
+	}
+	else {
+		// set status equal to whatever is returned from this function
+		status = executeOtherCommands(parsedCommand, shell->status);
+	}
 
-		// reset substitute
-		substitute = false;
+	// a timed job reports what it used, a builtin runs in the shell so the shell's own cpu time is reported
+	if (timed && LAST_USAGE.count != jobsBefore) {
+		printUsage(stderr, &LAST_USAGE);
 	}
-	// return the head of the struct
-	return head;
+	else if (timed && parsedCommand->background && !FOREGROUND_ONLY) {
+		fprintf(stderr, "time: background jobs are not timed\n");
+	}
+	else if (timed) {
+		struct jobUsage builtinUsage = {0};
+		struct rusage shellAfter;
+		getrusage(RUSAGE_SELF, &shellAfter);
+		timersub(&shellAfter.ru_utime, &shellBefore.ru_utime, &builtinUsage.usage.ru_utime);
+		timersub(&shellAfter.ru_stime, &shellBefore.ru_stime, &builtinUsage.usage.ru_stime);
+		builtinUsage.usage.ru_maxrss = shellAfter.ru_maxrss;
+		builtinUsage.usage.ru_majflt = shellAfter.ru_majflt - shellBefore.ru_majflt;
+		builtinUsage.usage.ru_minflt = shellAfter.ru_minflt - shellBefore.ru_minflt;
+		builtinUsage.usage.ru_nvcsw = shellAfter.ru_nvcsw - shellBefore.ru_nvcsw;
+		builtinUsage.usage.ru_nivcsw = shellAfter.ru_nivcsw - shellBefore.ru_nivcsw;
+		builtinUsage.wall = elapsedSince(&timedStart);
+		snprintf(builtinUsage.command, sizeof(builtinUsage.command), "%s", commandArgv[0]);
+		printUsage(stderr, &builtinUsage);
+	}
+
+	// $? expands to this in the next command
+	shell->status = status;
+	LAST_STATUS = status;
+	return status;
 }
 
-// function for status command
-void showStatus(int status)
+// function to run an && or || list followed by & as one job, a fork of the shell runs the list in a process group of its own
+int runListInBackground(struct commandNode* node, struct shellState* shell)
 {
-	// if status is 100, print the terminating signal of the last foreground process
-	if (status == 100) {
-		printf("terminated by signal %d\n", SIGNAL_NUMBER);
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		// stdin is /dev/null like for every background job, the list runs in the foreground of this shell.
+		// the job can be interrupted and stopped once fg gives it the terminal
+		setpgid(0, 0);
+		signal(SIGINT, SIG_DFL);
+		signal(SIGTSTP, SIG_DFL);
+		int null = open("/dev/null", O_RDONLY);
+		if (null != -1) {
+			dup2(null, STDIN_FILENO);
+			close(null);
+		}
+		node->background = false;
+		int status = runCommandList(node, shell);
+		exit(status == -1 ? 1 : status);
+	}
+	if (pid == -1) {
+		perror("fork");
 		fflush(stdout);
-		return;
+		return 1;
 	}
-	// else, print status
-	printf("exit value %d\n", status);
+
+	// the job is the child shell, its pid is the group of the whole list
+	setpgid(pid, pid);
+	struct job* job = addJob(pid, false);
+	job->number = nextJobNumber();
+	job->group = pid;
+	job->command = strdup(node->text);
+	clock_gettime(CLOCK_MONOTONIC, &job->started);
+	LAST_BACKGROUND_PID = pid;
+	printf("background pid is %d\n", pid);
 	fflush(stdout);
+	shell->status = 0;
+	LAST_STATUS = 0;
+	return 0;
 }
 
-// function for CD command
-int changeDirectory(struct command* userInput)
+// function to define the function of a node, its body is copied out of the arena of the line. a function defined again with the same body keeps its copy
+int defineFunction(struct commandNode* node, struct shellState* shell)
 {
-	// boolean value for argument, env variable for HOME
-	bool argument = false;
-	char* home = getenv("HOME");
+	struct shellFunction* function = findFunction(node->name);
+	if (function == NULL) {
+		unsigned int bucket = hashString(node->name, FUNCTION_TABLE_SIZE);
+		function = arenaAlloc(&FUNCTION_ARENA, sizeof(struct shellFunction));
+		function->name = arenaStrdup(&FUNCTION_ARENA, node->name);
+		function->body = NULL;
+		function->next = FUNCTIONS[bucket];
+		FUNCTIONS[bucket] = function;
+	}
+	if (function->body == NULL || strcmp(function->body->text, node->right->text) != 0) {
+		function->body = copyCommandNode(&FUNCTION_ARENA, node->right);
+	}
+	shell->status = 0;
+	LAST_STATUS = 0;
+	return 0;
+}
 
-	// check if there is an argument in user command
-	if (userInput->next->value != NULL) {
-		argument = true;
+// The signal handler for SIGINT while a loop runs
+void handle_loop_SIGINT(int signo) {
+	LOOP_INTERRUPTED = 1;
+}
+
+// function to count a loop that starts, the outermost one catches ^C until it ends
+void startLoop(struct shellState* shell, struct sigaction* saved)
+{
+	if (shell->loopDepth++ == 0) {
+		struct sigaction interruptAction = {0};
+		interruptAction.sa_handler = handle_loop_SIGINT;
+		interruptAction.sa_flags = SA_RESTART;
+		LOOP_INTERRUPTED = 0;
+		sigaction(SIGINT, &interruptAction, saved);
 	}
+}
 
-	// cd command has argument
-	if (argument) {
-		// check if user provided path is absolute (starts with /)
-		if (userInput->next->value[0] == '/') {
-			
-			// change directory to absolute path
-			int ret = chdir(userInput->next->value);
+// function to count a loop that ended and give back its status, the one of the last command it ran. ^C ends it like a command killed by SIGINT
+int endLoop(struct shellState* shell, struct sigaction* saved, int status)
+{
+	if (--shell->loopDepth == 0) {
+		sigaction(SIGINT, saved, NULL);
+	}
+	if (LOOP_INTERRUPTED) {
+		SIGNAL_NUMBER = SIGINT;
+		status = 128 + SIGINT;
+		if (shell->loopDepth == 0) {
+			LOOP_INTERRUPTED = 0;
+		}
+	}
+	if (status != -1) {
+		shell->status = status;
+		LAST_STATUS = status;
+	}
+	return status;
+}
 
-			// unsuccesful cd, send message and 1 status
-			if (ret != 0) {
-				printf("No such file or directory\n");
-				fflush(stdout);
-				return 1;
-			}
+// function to see if a loop stops after a round: a command that could not run, exit, return, ^C and break stop it, continue goes on.
+// break and continue for more loops than this one stop it too and are left to the loops around it. jobs that finished meanwhile are reaped
+bool loopDone(struct shellState* shell, int status)
+{
+	if (JOB_TABLE.count > 0) {
+		reapJobs(false);
+	}
+	if (status == -1 || shell->exiting || shell->jump == JUMP_RETURN || LOOP_INTERRUPTED || (killedBySignal(status) && SIGNAL_NUMBER == SIGINT)) {
+		return true;
+	}
+	if (shell->jump == JUMP_NONE) {
+		return false;
+	}
+	if (--shell->jumpLevels > 0) {
+		return true;
+	}
+	bool stop = (shell->jump == JUMP_BREAK);
+	shell->jump = JUMP_NONE;
+	return stop;
+}
 
-			// return 0 if succesful
-			return 0;
+// function to run a for loop: the words are expanded once, then the body runs with the variable set to each of them in turn.
+// everything a round tokenized is given back before the next one, so a long loop needs the memory of one round
+int runFor(struct commandNode* node, struct shellState* shell)
+{
+	struct parsedCommand* words = parseCommandLine(shell->arena, node->words);
+	if (words->error != NULL) {
+		printf("%s\n", words->error);
+		fflush(stdout);
+		return -1;
+	}
+	char** values = words->stageCount > 0 ? words->stages[0].argv : NULL;
+
+	int status = 0;
+	struct sigaction saved;
+	struct arenaMark mark = arenaSave(shell->arena);
+	startLoop(shell, &saved);
+	for (int i = 0; values != NULL && values[i] != NULL; i++)
+	{
+		arenaRewind(shell->arena, &mark);
+		setenv(node->name, values[i], 1);
+		status = runCommandList(node->right, shell);
+		if (loopDone(shell, status) || (shell->exitOnError && status != 0)) {
+			break;
 		}
+	}
+	return endLoop(shell, &saved, status);
+}
 
-		// else, create a relative path. concat /argument to end of current directory
-		char* currentDir = getcwd(NULL, 0);
-		int totalPathLength = strlen(currentDir) + strlen(userInput->next->value) + 2;
-		char relativePath [totalPathLength];
+// function to run a while loop, the body runs as long as the condition succeeds. until runs it as long as the condition fails
+int runWhile(struct commandNode* node, struct shellState* shell)
+{
+	int status = 0;
+	struct sigaction saved;
+	struct arenaMark mark = arenaSave(shell->arena);
+	startLoop(shell, &saved);
+	while (true)
+	{
+		arenaRewind(shell->arena, &mark);
+		int condition = runCommandList(node->left, shell);
+		if (loopDone(shell, condition)) {
+			status = (condition == -1) ? -1 : status;
+			break;
+		}
+		if ((condition == 0) != (node->type == NODE_WHILE)) {
+			break;
+		}
+		status = runCommandList(node->right, shell);
+		if (loopDone(shell, status) || (shell->exitOnError && status != 0)) {
+			break;
+		}
+	}
+	return endLoop(shell, &saved, status);
+}
 
-		relativePath[0] = '\0';
+// function to run a command line tree: ; runs both sides, && the right side only if the left one succeeded, || only if it failed.
+// returns the status of the last command that ran, -1 if a command could not be tokenized, which ends the line. -e ends it at a failed list.
+// break, continue and return skip the rest up to the loop or function they leave
+int runCommandList(struct commandNode* node, struct shellState* shell)
+{
+	if (node->type == NODE_COMMAND) {
+		return runCommand(node, shell);
+	}
+	if (node->type == NODE_FUNCTION) {
+		return defineFunction(node, shell);
+	}
+	if (node->background && !FOREGROUND_ONLY) {
+		return runListInBackground(node, shell);
+	}
+	if (node->type == NODE_FOR) {
+		return runFor(node, shell);
+	}
+	if (node->type == NODE_WHILE || node->type == NODE_UNTIL) {
+		return runWhile(node, shell);
+	}
 
-		strcat(relativePath, currentDir);
-		strcat(relativePath, "/");
-		strcat(relativePath, userInput->next->value);
+	int status = runCommandList(node->left, shell);
+	if (status == -1 || shell->exiting || shell->jump != JUMP_NONE) {
+		return status;
+	}
+	if ((node->type == NODE_SEQUENCE && shell->exitOnError && status != 0) || (node->type == NODE_AND && status != 0) || (node->type == NODE_OR && status == 0)) {
+		return status;
+	}
+	return runCommandList(node->right, shell);
+}
 
-		// change directory to relative path
-		int ret = chdir(relativePath);
+// function to note that a client hung up, its shell gets SIGHUP like a shell on a terminal that went away
+void hangUpClient(struct serverClient* client)
+{
+	if (!client->gone && client->shell > 0) {
+		killpg(client->shell, SIGHUP);
+	}
+	client->gone = true;
+}
 
-		// unsuccesful cd, send message and 1 status
-		if (ret != 0) {
-			printf("No such file or directory\n");
-			fflush(stdout);
-			return 1;
+// function to add a frame for the client to what is still to be sent: a type byte, the length in network order and the data
+void queueFrame(struct serverClient* client, char type, const char* data, uint32_t length)
+{
+	// output of a client that hung up is dropped
+	if (client->gone) {
+		return;
+	}
+	size_t needed = client->pendingLength + 5 + length;
+	if (needed > client->pendingCapacity) {
+		// move what is left of the buffer to the front before it grows
+		memmove(client->pending, client->pending + client->pendingStart, client->pendingLength - client->pendingStart);
+		client->pendingLength -= client->pendingStart;
+		client->pendingStart = 0;
+		needed = client->pendingLength + 5 + length;
+		while (needed > client->pendingCapacity) {
+			client->pendingCapacity = client->pendingCapacity ? client->pendingCapacity * 2 : 65536;
+		}
+		client->pending = realloc(client->pending, client->pendingCapacity);
+	}
+	uint32_t networkLength = htonl(length);
+	client->pending[client->pendingLength] = type;
+	memcpy(client->pending + client->pendingLength + 1, &networkLength, 4);
+	memcpy(client->pending + client->pendingLength + 5, data, length);
+	client->pendingLength += 5 + length;
+}
+
+// function to send a status frame, the status is an int in network order
+void queueStatus(struct serverClient* client, int status)
+{
+	uint32_t networkStatus = htonl((uint32_t)status);
+	queueFrame(client, 'X', (char*)&networkStatus, 4);
+}
+
+// function to send as much of what is pending as the socket takes without blocking, a client that hung up gets nothing more
+void flushClient(struct serverClient* client)
+{
+	while (!client->gone && client->pendingStart < client->pendingLength)
+	{
+		ssize_t sent = send(client->socketFD, client->pending + client->pendingStart, client->pendingLength - client->pendingStart, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (sent > 0) {
+			client->pendingStart += sent;
 		}
+		else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			return;
+		}
+		else if (errno != EINTR) {
+			hangUpClient(client);
+		}
+	}
+	client->pendingStart = 0;
+	client->pendingLength = 0;
+}
 
-		// return 0 if succesful
-		return 0;
+// function to tell epoll what to wait for on a client: the socket when there is something to send,
+// the output pipes unless too much is waiting to be sent already
+void watchClient(int epollFD, struct serverClient* client, int index)
+{
+	size_t waiting = client->pendingLength - client->pendingStart;
+	if (waiting > SERVER_PENDING_LIMIT) {
+		client->throttled = true;
+	}
+	else if (waiting < SERVER_PENDING_LIMIT / 2) {
+		client->throttled = false;
 	}
-	else {
-		chdir(home);  // go to home ENV variable
-		return 0;
+
+	// the kind of fd is in the low two bits of the event data, the client index above them
+	int fds[3] = { client->socketFD, client->outputFD, client->errorFD };
+	uint32_t events[3] = { waiting > 0 && !client->gone ? EPOLLOUT : 0, client->throttled ? 0 : EPOLLIN, client->throttled ? 0 : EPOLLIN };
+	for (int kind = 0; kind < 3; kind++)
+	{
+		// a socket that hung up would wake epoll for ever, it is not watched any more
+		if (kind == 0 && client->gone) {
+			epoll_ctl(epollFD, EPOLL_CTL_DEL, fds[kind], NULL);
+		}
+		else if (fds[kind] != -1) {
+			struct epoll_event event = { events[kind], { .u64 = (uint64_t)index << 2 | kind } };
+			epoll_ctl(epollFD, EPOLL_CTL_MOD, fds[kind], &event);
+		}
 	}
 }
 
-// run command in foreground
-int runInForeground(char* argv[], struct command* userInput, struct sigaction* SIGINT_action, struct sigaction* SIGTSTP_action)
+// function to read what the shell of a client wrote on one of its pipes and frame it, at most one buffer so other clients get a turn.
+// all of it when everything is wanted, before a status. the pipe is closed at end of file
+void drainClientPipe(struct serverClient* client, int* fd, char type, bool everything)
 {
-	int status = 0;				// status to be returned
-	pid_t childProcess = -5;  // dummy value
-	int childStatus;
-	pid_t childPid;
+	char buffer[65536];
+	while (*fd != -1)
+	{
+		ssize_t count = read(*fd, buffer, sizeof(buffer));
+		if (count > 0) {
+			queueFrame(client, type, buffer, count);
+			if (!everything) {
+				return;
+			}
+		}
+		else if (count == 0 || (errno != EAGAIN && errno != EINTR)) {
+			close(*fd);
+			*fd = -1;
+		}
+		else if (errno == EAGAIN) {
+			return;
+		}
+	}
+}
 
-	// boolean value to see if redirection is required
-	bool inputRedirection = false;
-	bool outputRedirection = false;
+// function to read the statuses the shell of a client reports after every command, output written before a status is sent before it
+void readClientStatus(struct serverClient* client)
+{
+	int status;
+	ssize_t count;
+	while ((count = read(client->statusFD, &status, sizeof(status))) == sizeof(status))
+	{
+		drainClientPipe(client, &client->outputFD, 'O', true);
+		drainClientPipe(client, &client->errorFD, 'E', true);
+		queueStatus(client, status);
+	}
+	if (count == 0 || (count == -1 && errno != EAGAIN && errno != EINTR)) {
+		close(client->statusFD);
+		client->statusFD = -1;
+	}
+}
 
-	//  string for input and output redirection
-	char changeInput[] = "<";
-	char changeOutput[] = ">";
+// function to start the shell of a new client, a fork of the server so there is no exec and no startup. returns its pid, 0 in the shell itself
+pid_t startClientShell(struct serverClient* client, int socketFD)
+{
+	int outputPipe[2], errorPipe[2], statusPipe[2];
+	if (pipe2(outputPipe, O_CLOEXEC) == -1 || pipe2(errorPipe, O_CLOEXEC) == -1 || pipe2(statusPipe, O_CLOEXEC) == -1) {
+		perror("server");
+		return -1;
+	}
+	pid_t shell = fork();
+	if (shell == 0)
+	{
+		// commands come in on the socket, output goes out through the pipes and a status after every command.
+		// a session of its own so a hang up reaches the shell and its foreground commands
+		setsid();
+		dup2(socketFD, STDIN_FILENO);
+		dup2(outputPipe[1], STDOUT_FILENO);
+		dup2(errorPipe[1], STDERR_FILENO);
+		SERVER_STATUS_FD = statusPipe[1];
 
-	// char pointer for input and ouput source
-	char* inputSource;
-	char* outputSource;
+		// nothing of the server is left open, the main loop sets up a signalfd of its own
+		int keep[1] = { SERVER_STATUS_FD };
+		closeOtherFDs(keep, 1);
+		SIGCHLD_FD = -1;
+		signal(SIGPIPE, SIG_DFL);
+		return 0;
+	}
 
-	//  pointers for output and input redirection
-	int targetFD;
-	int sourceFD;
+	// the server reads the pipes without blocking
+	close(outputPipe[1]);
+	close(errorPipe[1]);
+	close(statusPipe[1]);
+	client->outputFD = outputPipe[0];
+	client->errorFD = errorPipe[0];
+	client->statusFD = statusPipe[0];
+	fcntl(client->outputFD, F_SETFL, O_NONBLOCK);
+	fcntl(client->errorFD, F_SETFL, O_NONBLOCK);
+	fcntl(client->statusFD, F_SETFL, O_NONBLOCK);
+	if (shell == -1) {
+		perror("server");
+	}
+	return shell;
+}
 
-	// find if redirection is necessary
-	while (userInput->next != NULL)
-	{
-		// check for any input redirection
-		if (strcmp(changeInput, userInput->value) == 0) {
-			// inputRedirection to true and get source
-			inputRedirection = true;
-			inputSource = userInput->next->value;
-		}
+// function to let go of a client once its shell is gone and all of its output is sent
+bool finishClient(struct serverClient* client)
+{
+	if (client->outputFD != -1 || client->errorFD != -1 || client->statusFD != -1 || client->shell != -1) {
+		return false;
+	}
+	if (!client->gone && client->pendingStart < client->pendingLength) {
+		return false;
+	}
+	close(client->socketFD);
+	free(client->pending);
+	free(client);
+	return true;
+}
 
-		// check for any output redirection
-		if (strcmp(changeOutput, userInput->value) == 0) {
-			// outputRedirection to true and get source
-			outputRedirection = true;
-			outputSource = userInput->next->value;
-		}
+// function to serve command lines on a unix socket: smallsh --server path. one epoll loop moves the output of every client's shell
+// to its socket in frames. it only returns in the shell of a new client, which goes on as a shell reading the socket. -1 if it cannot serve
+int runServer(const char* path)
+{
+	struct sockaddr_un address = {0};
+	address.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(address.sun_path)) {
+		fprintf(stderr, "%s: socket path is too long\n", path);
+		return -1;
+	}
+	strcpy(address.sun_path, path);
 
-		// go to next user command
-		userInput = userInput->next;
+	// a socket file left by an old server is replaced
+	unlink(path);
+	int listenFD = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (listenFD == -1 || bind(listenFD, (struct sockaddr*)&address, sizeof(address)) == -1 || listen(listenFD, 128) == -1) {
+		perror(path);
+		return -1;
 	}
-	// If fork is successful, the value of spawnpid will be 0 in the child, the child's pid in the parent
-	childProcess = fork();
-	switch (childProcess)
-	{
-	case -1:
-		// fork fails send message and status of 1
-		perror("Command failed! Please try again!");
-		fflush(stdout);
-		exit(1);
-	// spawnpid is 0 in the child
-	case 0:  
-		SIGTSTP_action->sa_handler = SIG_IGN;   // Update SIG_IGN to ignore signal
-		sigaction(SIGTSTP, SIGTSTP_action, NULL);
-		sigfillset(&SIGTSTP_action->sa_mask);  // Block all catchable signals while handle_SIGTSTP is running
-		SIGTSTP_action->sa_flags = 0;   // No flags set
 
-		SIGINT_action->sa_handler = handle_SIGINT;   // set the sig handler
-		sigfillset(&SIGINT_action->sa_mask);  // Block all catchable signals while handle_SIGINT is running
-		SIGINT_action->sa_flags = 0;   // No flags set
-		sigaction(SIGINT, SIGINT_action, NULL);  // Install the signal handler
+	// shells of clients exit through the signalfd, a client that hangs up is an error on send instead of SIGPIPE
+	watchChildren();
+	signal(SIGPIPE, SIG_IGN);
+	int epollFD = epoll_create1(EPOLL_CLOEXEC);
+	struct epoll_event event = { EPOLLIN, { .u64 = SERVER_LISTEN_EVENT } };
+	epoll_ctl(epollFD, EPOLL_CTL_ADD, listenFD, &event);
+	event.data.u64 = SERVER_CHILD_EVENT;
+	epoll_ctl(epollFD, EPOLL_CTL_ADD, SIGCHLD_FD, &event);
 
-		// redirect input if necessary
-		if (inputRedirection)
+	// clients by index, a free slot is NULL
+	struct serverClient** clients = NULL;
+	int clientCapacity = 0;
+	struct epoll_event events[64];
+	while (true)
+	{
+		int ready = epoll_wait(epollFD, events, 64, -1);
+		for (int e = 0; e < ready; e++)
 		{
-			// open source file
-			sourceFD = open(inputSource, O_RDONLY);
+			uint64_t data = events[e].data.u64;
 
-			// source file cannot be opened, send status of 2
-			if (sourceFD == -1) {
-				printf("cannot open %s for input\n", inputSource);
-				fflush(stdout);
-				exit(2);
+			// new clients, each one gets a slot and a shell
+			if (data == SERVER_LISTEN_EVENT) {
+				int socketFD;
+				while ((socketFD = accept4(listenFD, NULL, NULL, SOCK_CLOEXEC)) != -1)
+				{
+					int index = 0;
+					while (index < clientCapacity && clients[index] != NULL) {
+						index++;
+					}
+					if (index == clientCapacity) {
+						clients = realloc(clients, (clientCapacity * 2 + 16) * sizeof(struct serverClient*));
+						memset(clients + clientCapacity, 0, (clientCapacity + 16) * sizeof(struct serverClient*));
+						clientCapacity = clientCapacity * 2 + 16;
+					}
+					struct serverClient* client = calloc(1, sizeof(struct serverClient));
+					client->socketFD = socketFD;
+					client->shell = startClientShell(client, socketFD);
+					if (client->shell == 0) {
+						free(client);
+						free(clients);
+						return 0;
+					}
+					if (client->shell == -1) {
+						close(socketFD);
+						free(client);
+						continue;
+					}
+					// the socket is stdin of the shell too, so it stays blocking and sends use MSG_DONTWAIT
+					clients[index] = client;
+					int fds[4] = { socketFD, client->outputFD, client->errorFD, client->statusFD };
+					for (int kind = 0; kind < 4; kind++)
+					{
+						struct epoll_event clientEvent = { kind == 0 ? 0 : EPOLLIN, { .u64 = (uint64_t)index << 2 | kind } };
+						epoll_ctl(epollFD, EPOLL_CTL_ADD, fds[kind], &clientEvent);
+					}
+				}
+				continue;
 			}
 
-			// Redirect stdin to source file
-			int result = dup2(sourceFD, 0);
-			if (result == -1) {
-				printf("cannot open %s for input\n", inputSource);
-				fflush(stdout);
-				exit(2);
+			// shells that exited, the exit status is the last frame their client gets
+			if (data == SERVER_CHILD_EVENT) {
+				struct signalfd_siginfo signalInfo;
+				while (read(SIGCHLD_FD, &signalInfo, sizeof(signalInfo)) > 0);
+				int childStatus;
+				pid_t pid;
+				while ((pid = waitpid(-1, &childStatus, WNOHANG)) > 0)
+				{
+					for (int i = 0; i < clientCapacity; i++)
+					{
+						if (clients[i] != NULL && clients[i]->shell == pid) {
+							clients[i]->shell = -1;
+							clients[i]->exitStatus = WIFEXITED(childStatus) ? WEXITSTATUS(childStatus) : 128 + WTERMSIG(childStatus);
+							readClientStatus(clients[i]);
+							drainClientPipe(clients[i], &clients[i]->outputFD, 'O', true);
+							drainClientPipe(clients[i], &clients[i]->errorFD, 'E', true);
+							queueStatus(clients[i], clients[i]->exitStatus);
+							flushClient(clients[i]);
+							if (finishClient(clients[i])) {
+								clients[i] = NULL;
+							}
+							else {
+								watchClient(epollFD, clients[i], i);
+							}
+						}
+					}
+				}
+				continue;
 			}
-		}
-
-		// redirect output if necssary
-		if (outputRedirection) 
-		{
-			// open the file and set permissions
-			targetFD = open(outputSource, O_WRONLY | O_CREAT | O_TRUNC, 0640);
 
-			// file cannot be opened, print error message and exit 1 as status
-			if (targetFD == -1) {
-				printf("cannot open %s for output\n", outputSource);
-				fflush(stdout);
-				exit(1);
+			// output, a status or room on the socket for one client
+			int index = data >> 2, kind = data & 3;
+			struct serverClient* client = clients[index];
+			if (client == NULL) {
+				continue;
 			}
-
-			// Redirect stdout to target file
-			int result = dup2(targetFD, 1);
-			if (result == -1) {
-				printf("cannot open %s for output\n", outputSource);
-				fflush(stdout);
-				exit(1);
+			if (kind == 1) {
+				drainClientPipe(client, &client->outputFD, 'O', false);
 			}
-		}
-		// call execv function
-		execvp(argv[0], argv);
-		// exec only returns if there is an error
-		perror(argv[0]);
-		fflush(stdout);
-		// send 2 as signal if error
-		exit(2);
-	default:
-		// wait for the child process
-		childPid = waitpid(childProcess, &childStatus, 0);
-
-		// send status of 1 if command failed, else send status of 0 for normal termination
-		if (WIFEXITED(childStatus)) 
-		{
-			// printf("Child %d exited normally with status %d\n", childProcess, WEXITSTATUS(childStatus));
-			if (WEXITSTATUS(childStatus) != 0) 
-			{
-				status = 1;
+			else if (kind == 2) {
+				drainClientPipe(client, &client->errorFD, 'E', false);
 			}
-			else 
-			{
-				status = 0;
+			else if (kind == 3) {
+				readClientStatus(client);
+			}
+			else if (events[e].events & (EPOLLERR | EPOLLHUP)) {
+				hangUpClient(client);
+			}
+			flushClient(client);
+			if (finishClient(client)) {
+				clients[index] = NULL;
+			}
+			else {
+				watchClient(epollFD, client, index);
 			}
-		}
-		else  // abnormal termination due to signal, send 1 as status.
-		{
-			SIGNAL_NUMBER = WTERMSIG(childStatus);
-			printf("terminated by signal %d\n", SIGNAL_NUMBER);
-			fflush(stdout);
-			status = 100;
 		}
 	}
-	return status;
 }
 
-// run command in background
-void runInBackground(char* argv[], struct command* userInput, struct zombieProcess* zombieList, struct sigaction* SIGTSTP_action)
+// function to run commands on a server and print what they write: smallsh --connect path [-c command]. without -c stdin is sent.
+// returns the exit status of the shell that ran them
+int runClient(const char* path, char* command)
 {
-	pid_t childProcess = -5;  // dummy value
-
-	// boolean value to see if redirection is required
-	bool inputRedirection = false;
-	bool outputRedirection = false;
-
-	//  string for input and output redirection and null
-	char null[] = "/dev/null";
-	char changeInput[] = "<";
-	char changeOutput[] = ">";
-
-	// char pointer for input and ouput source
-	char* inputSource;
-	char* outputSource;
+	struct sockaddr_un address = {0};
+	address.sun_family = AF_UNIX;
+	snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+	int socketFD = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (socketFD == -1 || connect(socketFD, (struct sockaddr*)&address, sizeof(address)) == -1) {
+		perror(path);
+		return 127;
+	}
 
-	//  pointers for output and input redirection
-	int targetFD;
-	int sourceFD;
+	// a command string is sent at once, the end of it ends the shell on the server
+	int inputFD = STDIN_FILENO;
+	if (command != NULL) {
+		size_t length = strlen(command);
+		if (writeAll(socketFD, command, length) == -1 || (length > 0 && command[length - 1] != '\n' && writeAll(socketFD, "\n", 1) == -1)) {
+			perror(path);
+			return 127;
+		}
+		shutdown(socketFD, SHUT_WR);
+		inputFD = -1;
+	}
 
-	// find if redirection is necessary
-	while (userInput->next != NULL)
+	// frames are taken apart as they come in, stdin goes out meanwhile
+	int status = 0;
+	size_t capacity = 65536, length = 0;
+	char* buffer = malloc(capacity);
+	while (true)
 	{
-		// check for any input redirection
-		if (strcmp(changeInput, userInput->value) == 0) {
-			// inputRedirection to true and get source
-			inputRedirection = true;
-			inputSource = userInput->next->value;
+		struct pollfd waitFDs[2] = { { socketFD, POLLIN, 0 }, { inputFD, POLLIN, 0 } };
+		if (poll(waitFDs, inputFD != -1 ? 2 : 1, -1) == -1) {
+			continue;
+		}
+		if (inputFD != -1 && (waitFDs[1].revents & (POLLIN | POLLHUP))) {
+			char input[65536];
+			ssize_t count = read(inputFD, input, sizeof(input));
+			if (count > 0) {
+				writeAll(socketFD, input, count);
+			}
+			else {
+				shutdown(socketFD, SHUT_WR);
+				inputFD = -1;
+			}
+		}
+		if (!(waitFDs[0].revents & (POLLIN | POLLHUP | POLLERR))) {
+			continue;
 		}
 
-		// check for any output redirection
-		if (strcmp(changeOutput, userInput->value) == 0) {
-			// outputRedirection to true and get source
-			outputRedirection = true;
-			outputSource = userInput->next->value;
+		if (length == capacity) {
+			capacity *= 2;
+			buffer = realloc(buffer, capacity);
 		}
-		// go to next user command
-		userInput = userInput->next;
-	}
-	// If fork is successful, the value of spawnpid will be 0 in the child, the child's pid in the parent
-	childProcess = fork();
-	switch (childProcess)
-	{
-	case -1:
-		// fork fails, send message and status of 1
-		perror("Command failed! Please try again!");
-		fflush(stdout);
-		exit(1);
-	case 0:  // spawnpid is 0 in the child
-		SIGTSTP_action->sa_handler = SIG_IGN;   // SIG_IGN as its signal handler
-		sigaction(SIGTSTP, SIGTSTP_action, NULL);
-		sigfillset(&SIGTSTP_action->sa_mask);  // Block all catchable signals while handle_SIGTSTP is running
-		SIGTSTP_action->sa_flags = 0;   // No flags set
+		ssize_t count = read(socketFD, buffer + length, capacity - length);
+		if (count <= 0) {
+			break;
+		}
+		length += count;
 
-		// redirect input if necessary
-		if (inputRedirection)
+		// every whole frame: O to stdout, E to stderr, X is a status
+		size_t used = 0;
+		while (length - used >= 5)
 		{
-			// open source file
-			sourceFD = open(inputSource, O_RDONLY);
-
-			// source file cannot be opened, send status of 2
-			if (sourceFD == -1) {
-				printf("cannot open %s for input\n", inputSource);
-				fflush(stdout);
-				exit(2);
+			uint32_t frameLength;
+			memcpy(&frameLength, buffer + used + 1, 4);
+			frameLength = ntohl(frameLength);
+			if (length - used - 5 < frameLength) {
+				break;
 			}
-
-			// Redirect stdin to source file
-			int result = dup2(sourceFD, 0);
-			if (result == -1) {
-				printf("cannot open %s for input\n", inputSource);
-				fflush(stdout);
-				exit(2);
+			char* frame = buffer + used + 5;
+			if (buffer[used] == 'O') {
+				writeAll(STDOUT_FILENO, frame, frameLength);
 			}
-		} 
-		else
-		{
-			// set source file to /dev/null
-			sourceFD = open(null, O_RDONLY);
-
-			// source file cannot be opened, send status of 2
-			if (sourceFD == -1) {
-				printf("cannot open %s for input\n", inputSource);
-				fflush(stdout);
-				exit(2);
+			else if (buffer[used] == 'E') {
+				writeAll(STDERR_FILENO, frame, frameLength);
 			}
-
-			// Redirect stdin to /dev/null
-			int result = dup2(sourceFD, 0);
-			if (result == -1) {
-				printf("cannot open %s for input\n", inputSource);
-				fflush(stdout);
-				exit(2);
+			else if (buffer[used] == 'X' && frameLength == 4) {
+				uint32_t networkStatus;
+				memcpy(&networkStatus, frame, 4);
+				status = (int)ntohl(networkStatus);
 			}
+			used += 5 + frameLength;
 		}
+		memmove(buffer, buffer + used, length - used);
+		length -= used;
+		while (length + 5 > capacity) {
+			capacity *= 2;
+			buffer = realloc(buffer, capacity);
+		}
+	}
+	free(buffer);
+	close(socketFD);
+	return status;
+}
 
-		// redirect output if necssary
-		if (outputRedirection)
-		{
-			// open the file and set permissions
-			targetFD = open(outputSource, O_WRONLY | O_CREAT | O_TRUNC, 0640);
-
-			// file cannot be opened, print error message and exit 1 as status
-			if (targetFD == -1) {
-				printf("cannot open %s for output\n", outputSource);
-				fflush(stdout);
-				exit(1);
-			}
-
-			// Redirect stdout to target file
-			int result = dup2(targetFD, 1);
-			if (result == -1) {
-				printf("cannot open %s for output\n", outputSource);
-				fflush(stdout);
-				exit(1);
-			}
-		}  
-		else
+// function to parse a whole script, one item per command line. a line that cannot run is an item with its error, parsing goes on at the next line
+void parseScript(struct parsedScript* script, const char* text)
+{
+	struct listParser parser = { &script->arena, text, NULL, false };
+	int capacity = 0;
+	while (*parser.c != '\0')
+	{
+		const char* start = parser.c;
+		struct commandNode* list = parseList(&parser, false);
+		if (parser.error != NULL) {
+			parser.c += strcspn(parser.c, "\n");
+		}
+		if (list != NULL || parser.error != NULL)
 		{
-			// set to /dev/null
-			targetFD = open(null, O_WRONLY | O_CREAT | O_TRUNC, 0640);
-
-			// file cannot be opened, print error message and exit 1 as status
-			if (targetFD == -1) {
-				printf("cannot open %s for output\n", outputSource);
-				fflush(stdout);
-				exit(1);
-			}
-
-			// Redirect stdout to /dev/null
-			int result = dup2(targetFD, 1);
-			if (result == -1) {
-				printf("cannot open %s for output\n", outputSource);
-				fflush(stdout);
-				exit(1);
+			if (script->count == capacity) {
+				capacity = capacity * 2 + 64;
+				script->items = realloc(script->items, capacity * sizeof(struct scriptItem));
 			}
+			struct scriptItem* item = &script->items[script->count++];
+			item->list = list;
+			item->error = parser.error;
+			item->start = start - text;
+			item->end = parser.c - text + (*parser.c == '\n');
+		}
+		parser.error = NULL;
+		parser.incomplete = false;
+		if (*parser.c == '\n') {
+			parser.c++;
 		}
-		// call execv function
-		execvp(argv[0], argv);
-		// exec only returns if there is an error
-		perror(argv[0]);
-		fflush(stdout);
-		// send 2 as signal if error
-		exit(2);
-	default:
-		// put in process id and make next zombie
-		zombieList->zombie_pid = childProcess;
-		zombieList->next = makeZombie();
-		// print the background pid
-		printf("background pid is %d\n", zombieList->zombie_pid);
 	}
 }
 
-// function to get argv of user command to be used in execvp()
-void buildArgv(char* argv[], struct command* userInput)
+// function to find the file the cache of a script is kept in: one per script in $SMALLSH_CACHE or ~/.cache/smallsh, named by a hash of the
+// full path of the script. an empty SMALLSH_CACHE turns the cache off, false if there is none. create makes the directories
+bool scriptCachePath(const char* fullPath, char* cachePath, size_t size, bool create)
 {
-	// printf("build argv\n");
-	//  string for backgroundOperator, input and output
-	char backgroundOperator[] = "&";
-	char changeInput[] = "<";
-	char changeOutput[] = ">";
-
-	// idx for array
-	int idx = 0;
-
-	// get arguments in array format. while loop as long as command is not  > or <.
-	while (userInput->next != NULL)
-	{
-		// exit if input direction, output redirection, or & operator
-		if (strcmp(changeInput, userInput->value) == 0 || strcmp(changeOutput, userInput->value) == 0 || strcmp(backgroundOperator, userInput->value) == 0) {
-			break;
+	char* directory = getenv("SMALLSH_CACHE");
+	char defaultDirectory[4096];
+	if (directory == NULL) {
+		char* home = getenv("HOME");
+		if (home == NULL) {
+			return false;
+		}
+		snprintf(defaultDirectory, sizeof(defaultDirectory), "%s/.cache", home);
+		if (create) {
+			mkdir(defaultDirectory, 0700);
 		}
+		snprintf(defaultDirectory, sizeof(defaultDirectory), "%s/.cache/smallsh", home);
+		directory = defaultDirectory;
+	}
+	if (*directory == '\0') {
+		return false;
+	}
+	if (create) {
+		mkdir(directory, 0700);
+	}
 
-		// pointer for string and dereference pointer
-		char* cmd;
-		cmd = userInput->value;
+	// 64 bit FNV-1a of the path, the path itself is checked again when the file is loaded
+	uint64_t hash = 14695981039346656037ull;
+	for (const char* c = fullPath; *c; c++) {
+		hash = (hash ^ (unsigned char)*c) * 1099511628211ull;
+	}
+	snprintf(cachePath, size, "%s/%016llx", directory, (unsigned long long)hash);
+	return true;
+}
 
-		// put command in argv and increment idx
-		argv[idx] = cmd;
-		idx++;
+// function to write a string to a script cache file: its length, then its bytes. NULL has a length of its own
+void writeCacheString(FILE* file, const char* s)
+{
+	uint32_t length = s != NULL ? strlen(s) : UINT32_MAX;
+	fwrite(&length, sizeof(length), 1, file);
+	if (s != NULL) {
+		fwrite(s, 1, length, file);
+	}
+}
 
-		// go to next user command
-		userInput = userInput->next;
+// function to write a tree to a script cache file, every node before its children. a missing node is a 0 byte
+void writeCacheNode(FILE* file, struct commandNode* node)
+{
+	unsigned char header[3] = { node != NULL, node != NULL ? node->type : 0, node != NULL && node->background };
+	fwrite(header, 1, node != NULL ? 3 : 1, file);
+	if (node != NULL) {
+		writeCacheString(file, node->text);
+		writeCacheString(file, node->name);
+		writeCacheString(file, node->words);
+		writeCacheNode(file, node->left);
+		writeCacheNode(file, node->right);
 	}
 }
 
-// function to execute other commands
-int executeOtherCommands(struct command* userInput, struct zombieProcess* zombieList, int current_status, struct sigaction* SIGINT_action, struct sigaction* SIGTSTP_action)
+// function to write a parsed script to its cache file. it is written to a file of its own that is renamed over the old one,
+// so a shell that loads the cache meanwhile never sees half of it
+void saveScriptCache(struct parsedScript* script, const char* cachePath, const char* fullPath, struct stat* scriptStat)
 {
-	// status to be returned from executing command
-	int status;
+	char tempPath[4096 + 64];
+	snprintf(tempPath, sizeof(tempPath), "%s.%d", cachePath, getpid());
+	int cacheFD = open(tempPath, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+	FILE* file = cacheFD != -1 ? fdopen(cacheFD, "w") : NULL;
+	if (file == NULL) {
+		if (cacheFD != -1) {
+			close(cacheFD);
+			unlink(tempPath);
+		}
+		return;
+	}
 
-	// boolean value to see if redirection is set
-	bool redirection = false;
+	struct scriptCacheHeader header = {0};
+	memcpy(header.magic, SCRIPT_CACHE_MAGIC, sizeof(header.magic));
+	header.device = scriptStat->st_dev;
+	header.inode = scriptStat->st_ino;
+	header.size = scriptStat->st_size;
+	header.seconds = scriptStat->st_mtim.tv_sec;
+	header.nanoseconds = scriptStat->st_mtim.tv_nsec;
+	header.count = script->count;
+	fwrite(&header, sizeof(header), 1, file);
+	writeCacheString(file, fullPath);
+	for (int i = 0; i < script->count; i++)
+	{
+		uint64_t span[2] = { script->items[i].start, script->items[i].end };
+		fwrite(span, sizeof(span), 1, file);
+		writeCacheString(file, script->items[i].error);
+		writeCacheNode(file, script->items[i].list);
+	}
 
-	//  string for backgroundOperator
-	char backgroundOperator[] = "&";
-	char changeInput[] = "<";
-	char changeOutput[] = ">";
+	bool written = !ferror(file);
+	if (fclose(file) != 0 || !written || rename(tempPath, cachePath) == -1) {
+		unlink(tempPath);
+	}
+}
 
-	// prior command and head node
-	struct command* head = userInput;
-	struct command* tail = NULL;
+// function to take size bytes from a script cache file, NULL if the file ends first
+const void* readCacheBytes(struct cacheReader* reader, size_t size)
+{
+	if (reader->bad || (size_t)(reader->end - reader->next) < size) {
+		reader->bad = true;
+		return NULL;
+	}
+	const void* bytes = reader->next;
+	reader->next += size;
+	return bytes;
+}
 
-	//count of arguments in user command
-	int argument_count = 0;
+// function to read a string of a script cache file into the arena, NULL for the NULL string or when the file ends first
+char* readCacheString(struct cacheReader* reader, struct arena* arena)
+{
+	uint32_t length;
+	const void* bytes = readCacheBytes(reader, sizeof(length));
+	if (bytes == NULL) {
+		return NULL;
+	}
+	memcpy(&length, bytes, sizeof(length));
+	if (length == UINT32_MAX || (bytes = readCacheBytes(reader, length)) == NULL) {
+		return NULL;
+	}
+	char* s = arenaAlloc(arena, length + 1);
+	memcpy(s, bytes, length);
+	s[length] = '\0';
+	return s;
+}
 
-	// while loop to last command to see if process needs to run in background
-	while (userInput->next != NULL)
-	{
-		// check for any input or output redirection
-		if (strcmp(changeInput, userInput->value) == 0 || strcmp(changeOutput, userInput->value) == 0) {
-			// set redirection, inputRedirection to true
-			redirection = true;
-		}
+// function to read a tree of a script cache file into the arena. a node without the children or names its type needs makes the file bad,
+// so does a tree deeper than SCRIPT_CACHE_DEPTH_LIMIT, the reader would run out of stack before the file runs out
+struct commandNode* readCacheNode(struct cacheReader* reader, struct arena* arena, int depth)
+{
+	const unsigned char* present = readCacheBytes(reader, 1);
+	if (present == NULL || *present == 0) {
+		return NULL;
+	}
+	if (depth >= SCRIPT_CACHE_DEPTH_LIMIT) {
+		reader->bad = true;
+		return NULL;
+	}
+	const unsigned char* header = readCacheBytes(reader, 2);
+	if (header == NULL || header[0] > NODE_FUNCTION) {
+		reader->bad = true;
+		return NULL;
+	}
+	struct commandNode* node = arenaAlloc(arena, sizeof(struct commandNode));
+	node->type = header[0];
+	node->background = header[1];
+	node->text = readCacheString(reader, arena);
+	node->name = readCacheString(reader, arena);
+	node->words = readCacheString(reader, arena);
+	node->left = readCacheNode(reader, arena, depth + 1);
+	node->right = reader->bad ? NULL : readCacheNode(reader, arena, depth + 1);
 
-		// only count argument, if no redirection and & operator
-		if (!redirection && strcmp(backgroundOperator, userInput->value) != 0) {
-			argument_count++;
+	bool needsLeft = node->type != NODE_COMMAND && node->type != NODE_FOR && node->type != NODE_FUNCTION;
+	bool needsName = node->type == NODE_FOR || node->type == NODE_FUNCTION;
+	if (node->text == NULL || (needsLeft && node->left == NULL) || (node->type != NODE_COMMAND && node->right == NULL) || (needsName && node->name == NULL) || (node->type == NODE_FOR && node->words == NULL)) {
+		reader->bad = true;
+	}
+	return node;
+}
+
+// function to load a parsed script from its cache file, only if the file was made from the script as it is now: same path, inode, size and mtime.
+// -1 if there is no such cache
+int loadScriptCache(struct parsedScript* script, const char* cachePath, const char* fullPath, struct stat* scriptStat)
+{
+	int cacheFD = open(cachePath, O_RDONLY | O_CLOEXEC);
+	struct stat cacheStat;
+	if (cacheFD == -1 || fstat(cacheFD, &cacheStat) == -1 || cacheStat.st_size < (off_t)sizeof(struct scriptCacheHeader)) {
+		if (cacheFD != -1) {
+			close(cacheFD);
 		}
+		return -1;
+	}
+	char* map = mmap(NULL, cacheStat.st_size, PROT_READ, MAP_PRIVATE, cacheFD, 0);
+	close(cacheFD);
+	if (map == MAP_FAILED) {
+		return -1;
+	}
 
-		// go to next user command
-		tail = userInput;
-		userInput = userInput->next;
+	struct cacheReader reader = { map, map + cacheStat.st_size, false };
+	struct scriptCacheHeader header;
+	memcpy(&header, readCacheBytes(&reader, sizeof(header)), sizeof(header));
+	char* path = readCacheString(&reader, &script->arena);
+	if (memcmp(header.magic, SCRIPT_CACHE_MAGIC, sizeof(header.magic)) != 0 || header.device != (uint64_t)scriptStat->st_dev || header.inode != (uint64_t)scriptStat->st_ino
+		|| header.size != (uint64_t)scriptStat->st_size || header.seconds != scriptStat->st_mtim.tv_sec || header.nanoseconds != scriptStat->st_mtim.tv_nsec
+		|| path == NULL || strcmp(path, fullPath) != 0) {
+		reader.bad = true;
 	}
 
-	// if argument is greater than 512, print error message to user
-	if (argument_count > MAX_ARGUMENTS)
+	// every item is its span, its error and its tree, so the file holds at least that many bytes for each. a count it cannot hold is bad
+	size_t itemSize = 2 * sizeof(uint64_t) + sizeof(uint32_t) + 1;
+	if (!reader.bad && header.count > (size_t)(reader.end - reader.next) / itemSize) {
+		reader.bad = true;
+	}
+	if (!reader.bad) {
+		script->items = malloc((header.count ? header.count : 1) * sizeof(struct scriptItem));
+		reader.bad = script->items == NULL;
+	}
+	for (uint32_t i = 0; i < header.count && !reader.bad; i++)
 	{
-		printf("Too many arguments in command line!\n");
-		fflush(stdout);
-		return current_status;
+		uint64_t span[2];
+		const void* bytes = readCacheBytes(&reader, sizeof(span));
+		if (bytes == NULL) {
+			break;
+		}
+		memcpy(span, bytes, sizeof(span));
+		struct scriptItem* item = &script->items[script->count++];
+		item->start = span[0];
+		item->end = span[1];
+		item->error = readCacheString(&reader, &script->arena);
+		item->list = readCacheNode(&reader, &script->arena, 0);
+		if (item->start > item->end || item->end > header.size || (item->list == NULL && item->error == NULL)) {
+			reader.bad = true;
+		}
 	}
+	munmap(map, cacheStat.st_size);
 
-	// build argv of user command
-	char* argv[argument_count + 1];  // array of char pointers
-	argv[argument_count] = NULL;  // last index is NULL
-	buildArgv(argv, head);
-
-	// run in background
-	if (strcmp(backgroundOperator, tail->value) == 0 && !FOREGROUND_ONLY) {
-		// invoke runInBackground
-		runInBackground(argv, head, zombieList, SIGTSTP_action);
-		// set status to current status since process running in background and return status
-		status = current_status;
-		return status;
+	// a cache that does not fit is parsed again, like a missing one
+	if (reader.bad) {
+		free(script->items);
+		script->items = NULL;
+		script->count = 0;
+		arenaReset(&script->arena);
+		return -1;
 	}
-	// else, run in foreground and update status
-	status = runInForeground(argv, head, SIGINT_action, SIGTSTP_action);
-	return status;
+	return 0;
 }
 
-// function to clear zombie processes
-void clearZombieProcs(int current_status, struct zombieProcess* zombieList)
+// function to get the script a reader mapped parsed: from the cache when it has the file as it is now, else the text is parsed
+// and the cache written for the next run
+void loadScript(struct parsedScript* script, const char* path, struct lineReader* reader)
 {
-	// no pid for zombie or already killed, exit out of function
-	if (!zombieList->zombie_pid || zombieList->killed)
-	{
+	struct stat scriptStat;
+	char cachePath[4096 + 32];
+	char* fullPath = realpath(path, NULL);
+	bool cached = fullPath != NULL && stat(fullPath, &scriptStat) == 0 && scriptCachePath(fullPath, cachePath, sizeof(cachePath), false);
+	if (cached && loadScriptCache(script, cachePath, fullPath, &scriptStat) == 0) {
+		free(fullPath);
 		return;
 	}
-	// else, clear out zombie procedures
-	int   childStatus;
-	pid_t zombieStatus;
-	zombieStatus = waitpid(zombieList->zombie_pid, &childStatus, WNOHANG);
-
-	// send message to user if zombieStatus is cleared
-	if (zombieStatus != 0)
-	{
-		printf("background pid %d is done: ", zombieList->zombie_pid);
-		fflush(stdout);
-		// set killed to true
-		zombieList->killed = true;
-		if (WIFEXITED(childStatus)) {  // normal exit, send status
-			showStatus(WEXITSTATUS(childStatus));
 
-		}
-		else { // abnormal exit send signal number
-			printf("terminated by signal %d\n", WTERMSIG(childStatus));
-			fflush(stdout);
-		}
+	// the mapped file has no NUL at the end, the parser gets a copy that does
+	char* text = malloc(reader->end + 1);
+	memcpy(text, reader->buffer, reader->end);
+	text[reader->end] = '\0';
+	parseScript(script, text);
+	free(text);
+	if (cached && scriptCachePath(fullPath, cachePath, sizeof(cachePath), true)) {
+		saveScriptCache(script, cachePath, fullPath, &scriptStat);
 	}
+	free(fullPath);
 }
 
 int main(int argc, char* argv[])
 {
-	// exit, cd and status command
-	char exit[] = "exit", cd[] = "cd", status[] = "status";
+	// exit command and the time prefix
+	char exit[] = "exit";
 
 	// default status for execution
 	int exec_status = 0;
 
-	// array of chars to hold user command
-	char userCommand[2100];
+	// smallsh --bench-parse [lines] times the tokenizer and exits
+	if (argc > 1 && strcmp(argv[1], "--bench-parse") == 0) {
+		return benchParse(argc > 2 ? atoi(argv[2]) : 1000000);
+	}
+
+	// smallsh --connect socket [-c command] runs commands on a server
+	if (argc > 2 && strcmp(argv[1], "--connect") == 0) {
+		return runClient(argv[2], argc > 4 && strcmp(argv[3], "-c") == 0 ? argv[4] : NULL);
+	}
+
+	// smallsh --server socket only comes back here in the shell of a client, which reads its commands from the socket on stdin
+	bool serving = argc > 2 && strcmp(argv[1], "--server") == 0;
+	if (serving && runServer(argv[2]) == -1) {
+		return 1;
+	}
+
+	// pid of the shell never changes, $$ is replaced with this string
+	sprintf(PID_STRING, "%d", getpid());
+
+	// command line buffer, grows to fit the longest line. lines that finish a loop or function are read into the second one
+	char* userCommand = NULL;
+	size_t commandCapacity = 0;
+	char* moreCommand = NULL;
+	size_t moreCapacity = 0;
+
+	// arena for everything parsed from a command line
+	struct arena parseArena = {0};
+
+	// options: -e leaves at the first failing command, -c runs a command string instead of reading input
+	bool exitOnError = false;
+	char* commandString = NULL;
+	int option;
+	while (!serving && (option = getopt(argc, argv, "+ec:")) != -1)
+	{
+		switch (option)
+		{
+		case 'e':
+			exitOnError = true;
+			break;
+		case 'c':
+			commandString = optarg;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-e] [-c command | script]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	// reader for user commands: a -c string, a script file, or stdin. only a terminal gets a prompt
+	struct lineReader input;
+	if (commandString != NULL) {
+		readerFromString(&input, commandString);
+	}
+	else if (!serving && optind < argc) {
+		if (readerFromFile(&input, argv[optind]) == -1) {
+			perror(argv[optind]);
+			return 127;
+		}
+	}
+	else {
+		readerFromFD(&input, STDIN_FILENO, isatty(STDIN_FILENO));
+	}
+
+	// lines typed at a terminal are edited in raw mode, unless the terminal cannot move the cursor
+	char* terminal = getenv("TERM");
+	bool lineEditing = input.interactive && isatty(STDOUT_FILENO) && (terminal == NULL || strcmp(terminal, "dumb") != 0);
+
+	// child exits come in through the signalfd
+	watchChildren();
+
+	// fg takes the terminal back from a job while the shell is not in the foreground, which would stop it with SIGTTOU
+	struct sigaction ignoreAction = {0};
+	ignoreAction.sa_handler = SIG_IGN;
+	sigaction(SIGTTOU, &ignoreAction, NULL);
+
+	// history file is opened now but only read when it is first used
+	openHistory();
+
+	// SMALLSH_METRICS starts the metrics log right away, set metrics= changes it later
+	char* metricsPath = getenv("SMALLSH_METRICS");
+	if (metricsPath != NULL && *metricsPath != '\0' && openMetrics(metricsPath) == -1) {
+		perror(metricsPath);
+	}
+
+	// a script is parsed as a whole before it runs, or loaded from the script cache if it did not change since. its arguments are $1 and up
+	struct parsedScript script = {0};
+	bool scripted = commandString == NULL && !serving && optind < argc;
+	if (scripted) {
+		loadScript(&script, argv[optind], &input);
+		POSITIONAL_ARGS = argv + optind + 1;
+		POSITIONAL_COUNT = argc - optind - 1;
+	}
 
-	// reference to head and next node of zombie list
-	struct zombieProcess* zombieHead = makeZombie();
-	struct zombieProcess* currentZombie = NULL;
+	// what builtins get to see of the shell
+	struct shellState shell = { 0, &parseArena, &input, false, exitOnError, JUMP_NONE, 0, 0, 0, false };
 
 	// Initialize SIGINT_action & SIGTSTP_action struct to be empty
 	struct sigaction SIGINT_action = {0}, SIGTSTP_action = {0};
@@ -708,68 +8079,190 @@ int main(int argc, char* argv[])
 		// No flags set
 		SIGTSTP_action.sa_flags = 0;
 		sigaction(SIGTSTP, &SIGTSTP_action, NULL);
-		currentZombie = zombieHead; // reset to head of zombielist
 
-		// clear out zombie procs
-		while (currentZombie->next != NULL)
+		// last command is done, give back everything parsed from it
+		arenaReset(&parseArena);
+
+		// clear out jobs that finished while a foreground process ran
+		reapJobs(false);
+
+		// the next line of a script is its next item, lines a builtin read from the script itself are skipped
+		char* lineError = NULL;
+		struct commandNode* commandList = NULL;
+		if (scripted)
 		{
-			clearZombieProcs(exec_status, currentZombie);
-			currentZombie = currentZombie->next;
+			while (script.next < script.count && script.items[script.next].start < input.start) {
+				script.next++;
+			}
+			if (script.next == script.count) {
+				break;
+			}
+			struct scriptItem* item = &script.items[script.next++];
+			input.start = item->end;
+			commandList = item->list;
+			lineError = item->error;
 		}
+		else
+		{
+			// prompt only a user at a terminal
+			if (input.interactive) {
+				printf("%s", PROMPT);
+				fflush(stdout);
+			}
 
-		printf(": ");
-		fflush(stdout);
+			// store user command in array, end of input is the same as exit. a terminal gets the line editor
+			ssize_t len = lineEditing ? editLine(&input, &userCommand, &commandCapacity) : readCommandLine(&input, &userCommand, &commandCapacity);
+			if (len == -1) {
+				strcpy(userCommand, exit);
+				continue;
+			}
+
+			// check if command is blank or starts with #, reprompt user.
+			// very rare edge case where SIGTSTP enters a string length of 0
+			if (len == 1 || userCommand[0] == '#' || !len) {
+				continue;
+			}
+		
+			// strip new line at end of string, default behavior of fgets
+			if ((len > 0) && (userCommand[len - 1] == '\n')) {
+				userCommand[len - 1] = '\0';
+			}
+
+			// !!, !number and !prefix run an entry of the history again, the command is shown before it runs
+			if (userCommand[0] == '!' && userCommand[1] != '\0' && userCommand[1] != ' ' && userCommand[1] != '=') {
+				int id = recallHistory(userCommand + 1);
+				if (id == -1) {
+					printf("%s: event not found\n", userCommand);
+					fflush(stdout);
+					exec_status = 1;
+					shell.status = exec_status;
+					LAST_STATUS = exec_status;
+					if (SERVER_STATUS_FD != -1) {
+						write(SERVER_STATUS_FD, &exec_status, sizeof(exec_status));
+					}
+					continue;
+				}
+				unsigned int length;
+				const char* text = historyText(id, &length);
+				if (length + 1 > commandCapacity) {
+					commandCapacity = length + 1;
+					userCommand = realloc(userCommand, commandCapacity);
+				}
+				memcpy(userCommand, text, length);
+				userCommand[length] = '\0';
+				printf("%s\n", userCommand);
+				fflush(stdout);
+			}
+
+			// lines typed at a terminal go in the history
+			if (input.interactive) {
+				addHistory(userCommand);
+			}
 
-		// store user command in array
-		fgets(userCommand, 2100, stdin);
+			// split the line into its commands. a loop or function that goes on past the line reads more lines, a terminal prompts for them with >
+			bool incomplete;
+			struct arenaMark lineMark = arenaSave(&parseArena);
+			commandList = parseCommandList(&parseArena, userCommand, &lineError, &incomplete);
+			while (incomplete)
+			{
+				PROMPT = "> ";
+				if (input.interactive) {
+					printf("%s", PROMPT);
+					fflush(stdout);
+				}
+				ssize_t moreLength = lineEditing ? editLine(&input, &moreCommand, &moreCapacity) : readCommandLine(&input, &moreCommand, &moreCapacity);
+				PROMPT = ": ";
 
-		// strip new line at end of string, default behavior of fgets
-		int len = strlen(userCommand);
+				// ^C drops the whole command, end of input leaves it unfinished
+				if (moreLength == 0) {
+					commandList = NULL;
+					break;
+				}
+				if (moreLength == -1) {
+					arenaRewind(&parseArena, &lineMark);
+					commandList = parseCommandList(&parseArena, userCommand, &lineError, NULL);
+					break;
+				}
+				if (moreCommand[moreLength - 1] == '\n') {
+					moreCommand[--moreLength] = '\0';
+				}
+				if (input.interactive) {
+					addHistory(moreCommand);
+				}
 
-		// check if command exceeds 2048 characters, is blank or starts with #, reprompt user.
-		// very rare edge case where SIGTSTP enters a string length of 0
-		if (len > MAX_CHAR_LENGTH || len == 1 || userCommand[0] == '#' || !len) {
-			continue;
-		}
-		
-		// strip new line at end of string, default behavior of fgets
-		if ((len > 0) && (userCommand[len - 1] == '\n')) {
-			userCommand[len - 1] = '\0';
+				// the line goes on the command after a new line and all of it is parsed again
+				size_t length = strlen(userCommand);
+				if (length + moreLength + 2 > commandCapacity) {
+					commandCapacity = length + moreLength + 2;
+					userCommand = realloc(userCommand, commandCapacity);
+				}
+				userCommand[length] = '\n';
+				memcpy(userCommand + length + 1, moreCommand, moreLength + 1);
+				arenaRewind(&parseArena, &lineMark);
+				commandList = parseCommandList(&parseArena, userCommand, &lineError, &incomplete);
+			}
 		}
 
-		// create a linked list struct of user command
-		struct command* linkedListOfUserCommand = holdUserCommand(userCommand);
+		// a line that cannot run is told to the user and the prompt comes back. with -e it fails the shell
+		if (lineError != NULL) {
+			printf("%s\n", lineError);
+			fflush(stdout);
+		}
+		bool failed = lineError != NULL || (commandList != NULL && runCommandList(commandList, &shell) == -1);
+		exec_status = shell.status;
 
-		// only way to override strange bug, reset to 0. DONT USE MEMESET or userCommand[0] = '\0';
-		char userCommand[2100] = { 0 };
+		// a line that cannot be parsed or started failed, even if the last command that ran did not
+		if (failed && exec_status == 0) {
+			exec_status = 1;
+			shell.status = exec_status;
+			LAST_STATUS = exec_status;
+		}
 
-		// if command is cd
-		if (strcmp(cd, linkedListOfUserCommand->value) == 0) {
-			// return status after running this command
-			exec_status = changeDirectory(linkedListOfUserCommand);
+		// the shell of a server client reports the status of every line, the server sends it after the output of the command
+		if (SERVER_STATUS_FD != -1 && (failed || commandList != NULL)) {
+			write(SERVER_STATUS_FD, &exec_status, sizeof(exec_status));
+		}
+		if (failed) {
+			if (exitOnError) {
+				exec_status = 1;
+				break;
+			}
+			continue;
+		}
+		// line of only spaces, reprompt user
+		else if (commandList == NULL) {
+			continue;
 		}
-		// else if command is status
-		else if (strcmp(status, linkedListOfUserCommand->value) == 0) {
-			showStatus(exec_status);
+
+		// if exit command, leave the loop
+		if (shell.exiting) {
+			break;
 		}
-		// if not exit command
-		else  if (strcmp(exit, linkedListOfUserCommand->value) != 0) {
-			// set status equal to whatever is returned from this function
-			exec_status = executeOtherCommands(linkedListOfUserCommand, currentZombie, exec_status, &SIGINT_action, &SIGTSTP_action);
+
+		// -e leaves at the first command that fails
+		if (exitOnError && exec_status != 0) {
+			break;
 		}
 	} 
-	while (strcmp(exit, userCommand) != 0);  // user has entered exit command
-	struct zombieProcess* priorZombie = NULL;  // pointer to hold prior zombie
+	while (userCommand == NULL || strcmp(exit, userCommand) != 0);  // user has entered exit command
 
-	// loop through zombie list, kill all processes if not killed, then free zombie list
-	while (zombieHead->next != NULL)
+	// loop through job table, kill every job that is still running as a whole process group, relays one by one. then free job table
+	for (int i = 0; i < JOB_TABLE.capacity; i++)
 	{
-		if (!zombieHead->killed) 
+		if (JOB_TABLE.jobs[i].pid != 0 && JOB_TABLE.jobs[i].group != 0)
+		{
+			killpg(JOB_TABLE.jobs[i].group, SIGKILL);
+		}
+		else if (JOB_TABLE.jobs[i].pid != 0)
 		{
-			kill(zombieHead->zombie_pid, SIGKILL);
+			kill(JOB_TABLE.jobs[i].pid, SIGKILL);
 		}
-		priorZombie = zombieHead;
-		zombieHead = zombieHead->next;
-		free(priorZombie);
 	}
+	free(JOB_TABLE.jobs);
+	free(JOB_TABLE.buckets);
+	free(userCommand);
+	free(moreCommand);
+
+	// exit code of the shell is the status of the last command, 128 + signal if it was killed
+	return exec_status;
 }
\ No newline at end of file
@@ -0,0 +1,42 @@
+#!/bin/sh
+# Fan-out to several output files, run by make check.
+# usage: fanout.sh path/to/smallsh
+#
+# Every case feeds one command line to the shell on stdin and checks the files it wrote.
+# A file that fails (/dev/full) is dropped, the others still get every byte and the shell
+# does not hang. One line per case is printed, the exit status is the number of failures.
+
+SHELL_BIN=${1:-./smallsh}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+FAILED=0
+
+# run_case name command expected-bytes file...: the files must all hold expected-bytes bytes afterwards
+run_case() {
+	name=$1
+	line=$2
+	bytes=$3
+	shift 3
+	if ! echo "$line" | timeout 20 "$SHELL_BIN" > "$WORK/out" 2>&1; then
+		echo "FAIL $name: the shell hung or failed"
+		FAILED=$((FAILED + 1))
+		return
+	fi
+	for file in "$@"; do
+		got=$(wc -c < "$file")
+		if [ "$got" -ne "$bytes" ]; then
+			echo "FAIL $name: $file has $got bytes, expected $bytes"
+			FAILED=$((FAILED + 1))
+			return
+		fi
+	done
+	echo "ok   $name"
+}
+
+# more than one pipe's worth, so the relay goes round many times after the failure
+run_case "first file fails" "head -c 5000000 /dev/zero > /dev/full > $WORK/a" 5000000 "$WORK/a"
+run_case "middle file fails" "head -c 5000000 /dev/zero > $WORK/b > /dev/full > $WORK/c" 5000000 "$WORK/b" "$WORK/c"
+run_case "first of three fails" "head -c 300000 /dev/zero | cat > /dev/full > $WORK/d > $WORK/e" 300000 "$WORK/d" "$WORK/e"
+run_case "appending files" "head -c 300000 /dev/zero >> $WORK/f >> $WORK/g" 300000 "$WORK/f" "$WORK/g"
+
+exit $FAILED